@@ -1,142 +1,38 @@
 #include <iostream>
 #include <vector>
 #include <string>
-#include <queue>
-#include <map>
 #include <iomanip>
+#include <algorithm>
+#include <limits>
+#include <thread>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+
+#include "metrogo.h"
 
 using namespace std;
 
-vector<string> nodes;
-map<string, string> nodeToStation;
-vector<string> allStations;
-vector<pair<string, char>> AllStations;
-map<string, int> idToStation;
-map<string, int> nodeIDToIndex;
-map<string, vector<int>> stationNameToAllNodeIndexes;
+// Console front end over the MetroEngine library: the menu and the command
+// line options. Everything it shows comes from the plain result structs.
 
-class Ticket
+void display_Stations(MetroEngine &metro)
 {
-public:
-    string source;
-    string destination;
-    vector<string> shortestPath;
-    int distance;
-    double price;
-
-    Ticket(const string &src, const string &dest, const vector<string> &path, int dist, double cost)
-        : source(src), destination(dest), shortestPath(path), distance(dist), price(cost) {}
-
-    void printTicket() const
+    for (int i = 0; i < metro.stationCount(); i++)
     {
-        cout << "                                                                                                                                  \n";
-        cout << "                                                                                                                                    \n";
-        cout << "-----------------------------------------------------------------------------------------------------------------------------------\n";
-        cout << "                                                                                                                                    \n";
-        cout << "                                                                                                                                    \n";
-        cout << "\n\t\t\t--- TICKET ---" << endl;
-        cout << "Source Station: " << source << endl;
-        cout << "Destination Station: " << destination << endl;
-        cout << "Shortest Path: ";
-        for (size_t i = 0; i < shortestPath.size(); ++i)
-        {
-            cout << shortestPath[i];
-            if (i < shortestPath.size() - 1)
-                cout << " -> ";
-        }
-        cout << endl;
-        cout << "Distance: " << distance << " KM" << endl;
-        cout << "Price: Rs. " << price << endl;
-        cout << "\t\t\t---------------\n"
-             << endl;
-        cout << "                                                                                                                                    \n";
-        cout << "                                                                                                                                    \n";
-        cout << "-----------------------------------------------------------------------------------------------------------------------------------\n";
-        cout << "                                                                                                                                    \n";
-        cout << "                                                                                                                                    \n";
+        cout << i << "  " << metro.stationName(i) << endl;
     }
-};
-
-void addNodes(const vector<string> &line, char prefix)
-{
-    int x = allStations.size();
-    for (int i = 0; i < line.size(); ++i)
-    {
-        string nodeID = string(1, prefix) + to_string(i);
-        nodes.push_back(nodeID);
-        nodeToStation[nodeID] = line[i];
-        allStations.push_back(line[i]);
-        AllStations.push_back({line[i], prefix});
-        idToStation[line[i]] = x;
-        nodeIDToIndex[nodeID] = x;
-        stationNameToAllNodeIndexes[line[i]].push_back(x);
-        x++;
-    }
-}
-
-vector<vector<int>> adjMatrix;
-
-void initializeAdjMatrix()
-{
-    int n = nodes.size();
-    adjMatrix.resize(n, vector<int>(n, 0));
 }
 
-// void connect(int i, int j) {
-//     adjMatrix[i][j] = 1;
-//     adjMatrix[j][i] = 1; // undirected
-// }
-
-void constructLps(string &pat, vector<int> &lps)
+// Prints the suggestions for a partial station name in a grid; names that
+// only match with a typo are offered when nothing contains it exactly
+bool search(MetroEngine &metro, string s)
 {
-
-    // len stores the length of longest prefix which
-    // is also a suffix for the previous index
-    int len = 0;
-
-    // lps[0] is always 0
-    lps[0] = 0;
-
-    int i = 1;
-    while (i < pat.length())
-    {
-
-        // If characters match, increment the size of lps
-        if (pat[i] == pat[len])
-        {
-            len++;
-            lps[i] = len;
-            i++;
-        }
-
-        // If there is a mismatch
-        else
-        {
-            if (len != 0)
-            {
-
-                // Update len to the previous lps value
-                // to avoid reduntant comparisons
-                len = lps[len - 1];
-            }
-            else
-            {
-
-                // If no matching prefix found, set lps[i] to 0
-                lps[i] = 0;
-                i++;
-            }
-        }
-    }
-}
-
-bool search(string s)
-{
-    int m = s.length();
-    vector<int> lps(m);
-
-    // Construct the LPS array for the input string
-    constructLps(s, lps);
+    vector<int> matches = metro.searchStations(s, SEARCH_RESULT_LIMIT);
+    if (matches.empty())
+        for (const FuzzyMatch &match : metro.fuzzySearchStations(s, SEARCH_RESULT_LIMIT))
+            matches.push_back(match.station);
 
     // Number of columns in the grid
     const int columns = 3;
@@ -145,47 +41,16 @@ bool search(string s)
     cout << "\nSuggested Stations:\n";
     cout << "------------------------------------------------------------\n";
 
-    // Traverse through all station names
-    for (int k = 0; k < allStations.size(); k++)
+    for (int station : matches)
     {
-        int i = 0, j = 0;
-        int n = allStations[k].size();
-        string txt = allStations[k];
+        // Print the station in grid format
+        cout << setw(5) << station << " " << setw(25) << metro.stationName(station) << "\n";
+        count++;
 
-        // Perform KMP string matching
-        while (i < n)
+        // Add a newline after every 'columns' stations
+        if (count % columns == 0)
         {
-            if (txt[i] == s[j])
-            {
-                i++;
-                j++;
-
-                // If the entire pattern is matched
-                if (j == m)
-                {
-                    // Print the station in grid format
-                    cout << setw(5) << idToStation[allStations[k]] << " " << setw(25) << allStations[k] << "\n";
-                    count++;
-
-                    // Add a newline after every 'columns' stations
-                    if (count % columns == 0)
-                    {
-                        cout << endl;
-                    }
-                    break;
-                }
-            }
-            else
-            {
-                if (j != 0)
-                {
-                    j = lps[j - 1];
-                }
-                else
-                {
-                    i++;
-                }
-            }
+            cout << endl;
         }
     }
 
@@ -201,122 +66,59 @@ bool search(string s)
     return count > 0;
 }
 
-// Modified connect function to take weight (default is 1)
-void connect(int i, int j, int weight = 1)
-{
-    adjMatrix[i][j] = weight;
-    adjMatrix[j][i] = weight; // undirected
-}
-
-// Dijkstra algorithm using adjacency matrix
-void dijkstra(int src, vector<int> &dist, vector<int> &prev)
+void getShortestPath(MetroEngine &metro, int srcStation, int destStation)
 {
-    int n = adjMatrix.size();
-    dist.assign(n, INT_MAX);
-    prev.assign(n, -1);
-    vector<bool> visited(n, false);
-
-    dist[src] = 0;
-
-    for (int count = 0; count < n - 1; ++count)
-    {
-        int u = -1;
-        int minDist = INT_MAX;
-        for (int i = 0; i < n; ++i)
-            if (!visited[i] && dist[i] < minDist)
-            {
-                minDist = dist[i];
-                u = i;
-            }
-
-        if (u == -1)
-            break;
-        visited[u] = true;
+    Route route;
+    metro.shortestRoute(srcStation, destStation, route);
+    int minDistance = route.distance;
+    const vector<int> &bestPath = route.path;
 
-        for (int v = 0; v < n; ++v)
-            if (!visited[v] && adjMatrix[u][v] > 0 && dist[u] + adjMatrix[u][v] < dist[v])
-            {
-                dist[v] = dist[u] + adjMatrix[u][v];
-                prev[v] = u;
-            }
-    }
-}
-
-// Used in multi trip planning
-int minDistancee(string srcStation, string destStation)
-{
-    if (stationNameToAllNodeIndexes.find(srcStation) == stationNameToAllNodeIndexes.end() or stationNameToAllNodeIndexes.find(destStation) == stationNameToAllNodeIndexes.end())
-    {
-        cout << "Invalid station name.\n";
-        return 0;
-    }
-
-    vector<int> srcIndices = stationNameToAllNodeIndexes[srcStation];
-    vector<int> destIndices = stationNameToAllNodeIndexes[destStation];
-
-    int minDistance = INT_MAX;
-
-    for (int srcIndex : srcIndices)
+    if (bestPath.empty())
     {
-        vector<int> dist, prev;
-        dijkstra(srcIndex, dist, prev);
-
-        for (int destIndex : destIndices)
-        {
-            if (dist[destIndex] < minDistance) {
-                minDistance = dist[destIndex];
-            }
-        }
-    }
-
-    if (minDistance == INT_MAX) {
         cout << "No path found between stations.\n";
-        return 0;
+        return;
     }
-
-    return minDistance;
-}
-
-bool allVisited(vector<bool> &vis)
-{
-    for (bool v : vis)
+    cout << "-----------------------------------------------------------------------------------------------------------------------------------\n";
+    cout << "                                                                                                                                    \n";
+    cout << "                                                                                                                                    \n";
+    cout << "Shortest path from '" << metro.stationName(srcStation) << "' to '" << metro.stationName(destStation) << "':\n";
+    for (size_t i = 0; i < bestPath.size(); ++i)
     {
-        if (!v)
-            return false;
+        cout << metro.nodeName(bestPath[i]);
+        if (i < bestPath.size() - 1)
+            cout << " -> ";
     }
-    return true;
+    cout << "\nDistance: " << minDistance << "\n";
+    cout << "                                                                                                                                    \n";
+    cout << "                                                                                                                                    \n";
+    cout << "-----------------------------------------------------------------------------------------------------------------------------------\n";
 }
 
-int tsp(string s, vector<bool> &vis, vector<string> &locToVisit)
+void multiTripPlanner(MetroEngine &metro)
 {
-    if (allVisited(vis))
+    int k;
+    cout << "Enter number of stations to visit: ";
+    cin >> k;
+
+    if (k < 1)
     {
-        return minDistancee(s, locToVisit[0]); // Return to the starting station
+        cout << "Please enter at least 1 station.\n";
+        return;
     }
-
-    int mini = INT_MAX;
-    for (int i = 1; i < locToVisit.size(); i++)
+    if (k > MAX_EXACT_TRIP_STOPS)
     {
-        if (!vis[i])
-        {
-            vis[i] = true;
-            mini = min(mini, minDistancee(s, locToVisit[i]) + tsp(locToVisit[i], vis, locToVisit));
-            vis[i] = false;
-        }
+        cout << "More than " << MAX_EXACT_TRIP_STOPS << " stations, the best route found within "
+             << HEURISTIC_TRIP_BUDGET_MS << " ms will be used.\n";
     }
-    return mini;
-}
 
-void multiTripPlanner()
-{
-    int k;
-    cout << "Enter number of stations to visit (max 7): ";
-    cin >> k;
+    char roundTrip;
+    cout << "Return to the starting station at the end? (y/n): ";
+    cin >> roundTrip;
 
     // Clear the input buffer
     cin.ignore(numeric_limits<streamsize>::max(), '\n');
 
-    vector<string> locToVisit;
+    vector<int> locToVisit;
     for (int i = 0; i < k; ++i)
     {
         string partialName;
@@ -324,7 +126,7 @@ void multiTripPlanner()
         getline(cin, partialName);
 
         // Use the search function to find matching stations
-        search(partialName);
+        search(metro, partialName);
 
         int stationID;
         cout << "Select station ID: ";
@@ -334,7 +136,7 @@ void multiTripPlanner()
         cin.ignore(numeric_limits<streamsize>::max(), '\n');
 
         // Validate station ID
-        if (stationID < 0 || stationID >= allStations.size())
+        if (stationID < 0 || stationID >= metro.stationCount())
         {
             cout << "Invalid station ID. Please try again.\n";
             --i; // Retry the current station input
@@ -342,222 +144,80 @@ void multiTripPlanner()
         }
 
         // Add the selected station to the list
-        locToVisit.push_back(allStations[stationID]);
+        locToVisit.push_back(stationID);
     }
 
-    vector<bool> vis(locToVisit.size(), false);
-    vis[0] = true; // Mark the starting station as visited
+    bool returnToStart = roundTrip == 'y' || roundTrip == 'Y';
 
-    int result = tsp(locToVisit[0], vis, locToVisit);
-    cout << "Minimum distance to visit all stations: " << result << " KM" << endl;
-    cout << "Average Time Of Travel: " << result * 60.0 / 50 << " min" << endl;
-}
-
-vector<vector<int>> multiSourceBFS(const vector<int> &sources)
-{
-    int n = adjMatrix.size();
-    
-    // Store distances for each source
-    vector<vector<int>> distances(sources.size(), vector<int>(n, INT_MAX)); 
-    queue<pair<int, int>> q;  // {current station, distance from source}
-
-    // Perform BFS for each source
-    for (int srcIndex = 0; srcIndex < sources.size(); ++srcIndex)
+    TripPlan plan;
+    if (k <= MAX_EXACT_TRIP_STOPS)
     {
-        int src = sources[srcIndex];
-        distances[srcIndex][src] = 0;
-        q.push({src, 0});
-
-        while (!q.empty())
-        {
-            int current = q.front().first;
-            int dist = q.front().second;
-            q.pop();
-
-            // Traverse neighbors
-            for (int neighbor = 0; neighbor < n; ++neighbor)
-            {
-                if (adjMatrix[current][neighbor] > 0)
-                { 
-                    // If there's a connection, update the distance
-                    int newDist = dist + adjMatrix[current][neighbor];
-                    if (newDist < distances[srcIndex][neighbor])
-                    {
-                        distances[srcIndex][neighbor] = newDist;
-                        q.push({neighbor, newDist});
-                    }
-                }
-            }
-        }
-    }
-
-    return distances;
-}
-
-int findBestMeetingPoint(const vector<int> &sources)
-{
-    vector<vector<int>> distances = multiSourceBFS(sources);
-
-    int n = adjMatrix.size();
-    int minMaxDistance = INT_MAX;
-    int minTotalDistance = INT_MAX;
-    int bestStation = -1;
-
-    // Iterate over all stations
-    for (int station = 0; station < n; ++station)
-    {
-        int maxDistance = 0;
-        int totalDistance = 0;
-        bool reachable = true;
-
-        // Calculate max and total distance for this station
-        for (int srcIndex = 0; srcIndex < sources.size(); ++srcIndex)
-        {
-            int dist = distances[srcIndex][station];
-            if (dist == INT_MAX) {
-                reachable = false; // If any source cannot reach this station, skip it
-                break;
-            }
-            maxDistance = max(maxDistance, dist);
-            totalDistance += dist;
-        }
-
-        if (!reachable) continue;
-
-        // Update the best station
-        if (maxDistance < minMaxDistance or (maxDistance == minMaxDistance and totalDistance < minTotalDistance)) {
-            minMaxDistance = maxDistance;
-            minTotalDistance = totalDistance;
-            bestStation = station;
-        }
+        plan = metro.planTrip(locToVisit, returnToStart);
     }
-
-    return bestStation;
-}
-
-// Helper to reconstruct path
-vector<string> getPath(int src, int dest, const vector<int> &prev)
-{
-    vector<string> path;
-    for (int at = dest; at != -1; at = prev[at]) {
-        path.push_back(nodeToStation[nodes[at]]);
-    }
-        
-    reverse(path.begin(), path.end());
-    return path;
-}
-
-void addInterchange(const string &stationName)
-{
-    auto &ids = stationNameToAllNodeIndexes[stationName];
-    for (int i = 0; i < ids.size(); ++i)
+    else
     {
-        for (int j = i + 1; j < ids.size(); ++j)
-        {
-            // Add small weight for transfers
-            connect(ids[i], ids[j], 2); 
-        }
+        HeuristicTripResult h = metro.planTripHeuristic(locToVisit, returnToStart);
+        plan = h.plan;
+        if (!plan.order.empty())
+            cout << "Lower bound: " << h.lowerBound << " KM (route is at most "
+                 << (int)(h.gapPercent + 0.5) << "% above the optimum)\n";
     }
-}
 
-// User-friendly function to get shortest path
-void getShortestPaths(string srcStation, string destStation)
-{
-    if (idToStation.find(srcStation) == idToStation.end() or idToStation.find(destStation) == idToStation.end())
+    if (plan.order.empty())
     {
-        cout << "Invalid station name.\n";
+        cout << "No path found between stations.\n";
         return;
     }
 
-    int srcIndex = idToStation[srcStation];
-    int destIndex = idToStation[destStation];
-
-    vector<int> dist, prev;
-    dijkstra(srcIndex, dist, prev);
-    vector<string> path = getPath(srcIndex, destIndex, prev);
-    cout << "-----------------------------------------------------------------------------------------------------------------------------------\n";
-    cout << "                                                                                                                                    \n";
-    cout << "                                                                                                                                    \n";
-
-    cout << "Shortest path from '" << srcStation << "' to '" << destStation << "':\n";
-    // cout<<path[0];
-    // for(int i=1;i<path.size();i++){
-    //     if(idToStations[path[1]] > idToStation[path[0]]){
-    //         cout<<"Towards : "<<
-    //     }
-    // }
-    for (const auto &station : path)
+    cout << "Visiting order: ";
+    for (size_t i = 0; i < plan.order.size(); ++i)
     {
-        cout << station;
-        if (station != destStation)
+        cout << metro.stationName(locToVisit[plan.order[i]]);
+        if (i < plan.order.size() - 1)
             cout << " -> ";
     }
-    cout << "\nDistance: " << dist[destIndex] << "\n";
-    cout << "                                                                                                                                    \n";
-    cout << "                                                                                                                                    \n";
-    cout << "-----------------------------------------------------------------------------------------------------------------------------------\n";
+    if (returnToStart)
+        cout << " -> " << metro.stationName(locToVisit[0]);
+    cout << endl;
+
+    cout << "Minimum distance to visit all stations: " << plan.total << " KM" << endl;
+    cout << "Average Time Of Travel: " << plan.total * 60.0 / 50 << " min" << endl;
 }
 
-void getShortestPath(string srcStation, string destStation)
+// The ticket as shown at the counter (menu option 2)
+void printTicket(MetroEngine &metro, const Ticket &ticket)
 {
-    if (stationNameToAllNodeIndexes.find(srcStation) == stationNameToAllNodeIndexes.end() ||
-        stationNameToAllNodeIndexes.find(destStation) == stationNameToAllNodeIndexes.end())
+    const char *rule = "-----------------------------------------------------------------------------------------------------------------------------------\n";
+    string text;
+
+    text += "\n\n";
+    text += rule;
+    text += "\n\n\n\t\t\t--- TICKET ---\nSource Station: ";
+    text += metro.stationName(ticket.source);
+    text += "\nDestination Station: ";
+    text += metro.stationName(ticket.destination);
+    text += "\nShortest Path: ";
+    for (size_t i = 0; i < ticket.path.size(); ++i)
     {
-        cout << "Invalid station name.\n";
-        return;
+        text += metro.nodeName(ticket.path[i]);
+        if (i < ticket.path.size() - 1)
+            text += " -> ";
     }
-
-    vector<int> srcIndices = stationNameToAllNodeIndexes[srcStation];
-    vector<int> destIndices = stationNameToAllNodeIndexes[destStation];
-
-    int minDistance = INT_MAX;
-    vector<string> bestPath;
-
-    for (int srcIndex : srcIndices)
+    char buf[96];
+    snprintf(buf, sizeof(buf), "\nDistance: %d KM\nPrice: Rs. %g\n", ticket.distance, ticket.farePaise / 100.0);
+    text += buf;
+    if (ticket.minuteOfDay >= 0)
     {
-        vector<int> dist, prev;
-        dijkstra(srcIndex, dist, prev);
-
-        for (int destIndex : destIndices)
-        {
-            if (dist[destIndex] < minDistance)
-            {
-                minDistance = dist[destIndex];
-                bestPath = getPath(srcIndex, destIndex, prev);
-            }
-        }
-    }
-
-    if (bestPath.empty())
-    {
-        cout << "No path found between stations.\n";
-        return;
-    }
-    cout << "-----------------------------------------------------------------------------------------------------------------------------------\n";
-    cout << "                                                                                                                                    \n";
-    cout << "                                                                                                                                    \n";
-    cout << "Shortest path from '" << srcStation << "' to '" << destStation << "':\n";
-    for (size_t i = 0; i < bestPath.size(); ++i)
-    {
-        cout << bestPath[i];
-        if (i < bestPath.size() - 1)
-            cout << " -> ";
-    }
-    cout << "\nDistance: " << minDistance << "\n";
-    cout << "                                                                                                                                    \n";
-    cout << "                                                                                                                                    \n";
-    cout << "-----------------------------------------------------------------------------------------------------------------------------------\n";
-}
-
-void display_Stations()
-{
-    for (int i = 0; i < allStations.size(); i++)
-    {
-        cout << allStations[i] << endl;
+        snprintf(buf, sizeof(buf), "Travel Time: %02d:%02d\n", ticket.minuteOfDay / 60, ticket.minuteOfDay % 60);
+        text += buf;
     }
+    text += "\t\t\t---------------\n\n\n\n";
+    text += rule;
+    text += "\n\n";
+    cout << text;
 }
 
-void menu()
+void menu(MetroEngine &metro)
 {
     while (true)
     {
@@ -583,7 +243,7 @@ void menu()
         switch (choice)
         {
         case 1:
-            display_Stations();
+            display_Stations(metro);
             break;
 
         case 2:
@@ -596,7 +256,7 @@ void menu()
                 getline(cin, sourceStation);
 
                 // Use the search function and check if matches are found
-                if (search(sourceStation))
+                if (search(metro, sourceStation))
                 {
                     break; // Exit the loop if matches are found
                 }
@@ -618,7 +278,7 @@ void menu()
                 cin >> destinationStation;
 
                 // Use the search function and check if matches are found
-                if (search(destinationStation))
+                if (search(metro, destinationStation))
                 {
                     // Exit the loop if matches are found
                     break; 
@@ -633,21 +293,22 @@ void menu()
             cout << "Select station ID: ";
             cin >> b;
 
-            // Get the shortest path and distance
-            vector<int> dist, prev;
-            dijkstra(a, dist, prev);
-            vector<string> path = getPath(a, b, prev);
-            int distance = dist[b];
-
-            // Calculate ticket price (e.g., Rs. 5 per KM)
-            double price = distance * 5;
-            if (price > 60) {
-                price = 60;
+            if (a < 0 || a >= metro.stationCount() || b < 0 || b >= metro.stationCount())
+            {
+                cout << "Invalid station ID.\n";
+                break;
             }
 
-            // Generate and print the ticket
-            Ticket ticket(allStations[a], allStations[b], path, distance, price);
-            ticket.printTicket();
+            // Route and price the ticket; the time of day only matters when
+            // the fare rules have peak or off-peak periods
+            Ticket ticket;
+            metro.issueTicket(ticket, 1, a, b, metro.hasFarePeriods() ? currentMinuteOfDay() : -1);
+            if (ticket.error)
+            {
+                cout << ticket.error << ".\n";
+                break;
+            }
+            printTicket(metro, ticket);
             break;
         }
 
@@ -660,7 +321,7 @@ void menu()
                 cin.ignore();
                 getline(cin, sourceStation);
 
-                if (search(sourceStation)) break;
+                if (search(metro, sourceStation)) break;
                 else {
                     cout << "No matching stations found. Please try again.\n";
                 }
@@ -677,7 +338,7 @@ void menu()
                 cin.ignore();
                 cin >> destinationStation;
 
-                if (search(destinationStation)) break;
+                if (search(metro, destinationStation)) break;
                 else {
                     cout << "No matching stations found. Please try again.\n";
                 }
@@ -687,7 +348,12 @@ void menu()
             cout << "Select station ID: ";
             cin >> b;
 
-            getShortestPath(allStations[a], allStations[b]);
+            if (a < 0 || a >= metro.stationCount() || b < 0 || b >= metro.stationCount())
+            {
+                cout << "Invalid station ID.\n";
+                break;
+            }
+            getShortestPath(metro, a, b);
             break;
         }
 
@@ -697,35 +363,65 @@ void menu()
             int numFriends;
             cin >> numFriends;
 
-            vector<int> sources;
+            vector<int> friendStations;
             for (int i = 0; i < numFriends; ++i)
             {
                 cout << "Enter the starting station for friend " << i + 1 << ": ";
                 string station;
                 cin.ignore();
                 getline(cin, station);
-                search(station);
+                search(metro, station);
                 int stationID;
                 cout << "Select station ID: ";
                 cin >> stationID;
-                sources.push_back(stationID);
+                if (stationID < 0 || stationID >= metro.stationCount())
+                {
+                    cout << "Invalid station ID. Please try again.\n";
+                    --i;
+                    continue;
+                }
+                friendStations.push_back(stationID);
             }
 
-            // Find the best meeting point
-            int bestStation = findBestMeetingPoint(sources);
-            if (bestStation != -1)
+            int objective = 1;
+            cout << "Meet where (1) the longest journey or (2) the total distance is smallest? ";
+            cin >> objective;
+
+            // Find the best meeting points
+            const size_t shown = 3;
+            vector<MeetingPoint> points = metro.findMeetingPoints(friendStations,
+                                                            objective == 2 ? MeetingObjective::MinSum : MeetingObjective::MinMax,
+                                                            shown, max(1u, thread::hardware_concurrency()));
+            if (points.empty())
             {
-                cout << "The best meeting point is: " << allStations[bestStation] << endl;
+                cout << "No valid meeting point found.\n";
+                break;
             }
-            else
+
+            cout << "The best meeting point is: " << metro.stationName(points[0].station) << endl;
+            for (size_t p = 0; p < points.size(); ++p)
             {
-                cout << "No valid meeting point found.\n";
+                cout << "\n"
+                     << p + 1 << ". " << metro.stationName(points[p].station) << " (longest journey " << points[p].maxDistance
+                     << " KM, total " << points[p].totalDistance << " KM)\n";
+                for (size_t f = 0; f < points[p].paths.size(); ++f)
+                {
+                    cout << "   Friend " << f + 1 << ": ";
+                    const vector<int> &path = points[p].paths[f];
+                    for (size_t i = 0; i < path.size(); ++i)
+                    {
+                        cout << metro.nodeName(path[i]);
+                        if (i < path.size() - 1)
+                            cout << " -> ";
+                    }
+                    cout << "\n";
+                }
             }
             break;
         }
         case 5:
         {
-            multiTripPlanner();
+            multiTripPlanner(metro);
             break;
         }
 
@@ -736,110 +432,225 @@ void menu()
     }
 }
 
-int main()
+int main(int argc, char *argv[])
 {
-    // Red Line Stations
-    vector<string> redLineStations = {
-        "Shaheed Sthal (New Bus Adda)", "Hindon River", "Arthala", "Mohan Nagar",
-        "Shyam Park", "Major Mohit Sharma Rajendra Nagar", "Raj Bagh", "Shaheed Nagar",
-        "Dilshad Garden", "Jhilmil", "Mansarovar Park", "Shahdara", "Welcome",
-        "Seelampur", "Shastri Park", "Kashmere Gate", "Tis Hazari", "Pul Bangash",
-        "Pratap Nagar", "Shastri Nagar", "Inderlok", "Kanhaiya Nagar", "Keshav Puram",
-        "Netaji Subhash Place", "Kohat Enclave", "Pitampura", "Rohini East",
-        "Rohini West", "Rithala"};
-
-    // Blue Line Stations (Main Line and Branch Line)
-    vector<string> blueLineStations = {
-        // Main Line
-        "Dwarka Sector 21", "Dwarka Sector 8", "Dwarka Sector 9", "Dwarka Sector 10",
-        "Dwarka Sector 11", "Dwarka Sector 12", "Dwarka Sector 13", "Dwarka Sector 14",
-        "Dwarka", "Dwarka Mor", "Nawada", "Uttam Nagar West", "Uttam Nagar East",
-        "Janakpuri West", "Janakpuri East", "Tilak Nagar", "Subhash Nagar",
-        "Tagore Garden", "Rajouri Garden", "Ramesh Nagar", "Moti Nagar",
-        "Kirti Nagar", "Shadipur", "Patel Nagar", "Rajendra Place", "Karol Bagh",
-        "Jhandewalan", "Ramakrishna Ashram Marg", "Rajiv Chowk", "Barakhamba Road",
-        "Mandi House", "Pragati Maidan", "Indraprastha", "Yamuna Bank",
-        "Akshardham", "Mayur Vihar Phase-1", "Mayur Vihar Extention",
-        "New Ashok Nagar", "Noida Sector 15", "Noida Sector 16", "Noida Sector 18",
-        "Botanical Garden", "Golf Course", "Noida City Centre", "Noida Sector 34",
-        "Noida Sector 52", "Noida Sector 61", "Noida Sector 59", "Noida Sector 62",
-        "Noida Electronic City",
-        // Branch Line
-        "Yamuna Bank", "Laxmi Nagar", "Nirman Vihar", "Preet Vihar", "Karkarduma",
-        "Anand Vihar", "Kaushambi", "Vaishali"};
-
-    // Yellow Line Stations
-    vector<string> yellowLineStations = {
-        "Samaypur Badli", "Rohini Sector 18,19", "Haiderpur Badli Mor", "Jahangirpuri",
-        "Adarsh Nagar", "Azadpur", "Model Town", "GTB Nagar", "Vishwa Vidyalaya",
-        "Vidhan Sabha", "Civil Lines", "Kashmere Gate", "Chandni Chowk",
-        "Chawri Bazar", "New Delhi", "Rajiv Chowk", "Patel Chowk", "Central Secretariat",
-        "Udyog Bhawan", "Lok Kalyan Marg", "Jor Bagh", "INA", "AIIMS", "Green Park",
-        "Hauz Khas", "Malviya Nagar", "Saket", "Qutub Minar", "Chhatarpur",
-        "Sultanpur", "Ghitorni", "Arjan Garh", "Guru Dronacharya", "Sikandarpur",
-        "MG Road", "IFFCO Chowk", "Huda City Centre"};
-
-    // Pink Line Stations
-    vector<string> pinkLineStations = {
-        "Majlis Park", "Azadpur", "Shalimar Bagh", "Netaji Subhash Place", "Shakurpur",
-        "Punjabi Bagh West", "ESI Hospital", "Rajouri Garden", "Mayapuri", "Naraina Vihar",
-        "Delhi Cantt", "Durgabai Deshmukh South Campus", "Sir M. Vishweshwaraiah Moti Bagh",
-        "Bhikaji Cama Place", "Sarojini Nagar", "INA", "South Extension", "Lajpat Nagar",
-        "Vinobapuri", "Ashram", "Hazrat Nizamuddin", "Mayur Vihar Phase-1",
-        "Mayur Vihar Pocket-1", "Trilokpuri Sanjay Lake", "Vinod Nagar East",
-        "Mandawali - West Vinod Nagar", "IP Extension", "Anand Vihar", "Karkarduma",
-        "Karkarduma Court", "Krishna Nagar", "East Azad Nagar", "Welcome", "Jaffrabad",
-        "Maujpur - Babarpur", "Gokulpuri", "Johri Enclave", "Shiv Vihar"};
-
-    // Display sample output
-    // std::cout << "Total Red Line Stations: " << redLineStations.size() << "\n";
-    // std::cout << "Total Blue Line Stations: " << blueLineStations.size() << "\n";
-    // std::cout << "Total Yellow Line Stations: " << yellowLineStations.size() << "\n";
-    // std::cout << "Total Pink Line Stations: " << pinkLineStations.size() << "\n";
-
-    addNodes(redLineStations, 'R');
-    addNodes(blueLineStations, 'B');
-    addNodes(yellowLineStations, 'Y');
-    addNodes(pinkLineStations, 'P');
-
-    initializeAdjMatrix();
-
-    // Example connections (consecutive stations in each line)
-    for (int i = 0; i < redLineStations.size() - 1; ++i) {
-        connect(i, i + 1); // R0-R1-R2-R3...
+    // Options:
+    //   --network <file>         load the network from a text file (see loadNetworkFile)
+    //   --snapshot <file>        load a binary snapshot written by --write-snapshot
+    //   --write-snapshot <file>  write a snapshot of the loaded network and exit
+    //   --write-od-matrix <file> write the distance and fare of every station pair (see writeOdMatrix) and exit
+    //   --od-matrix <file>       answer OD queries from a matrix written by --write-od-matrix
+    //   --batch [file]           answer queries without the menu (stdin if no file)
+    //   --tickets [file]         issue one ticket per "source|destination[|HH:MM]" line (stdin if no file)
+    //   --isochrones <radius> [file]
+    //                            list the stations within radius of each station named in the file (stdin if no file)
+    //   --assign [file]          load of every segment and interchange for the "source|destination|trips" lines (stdin if no file)
+    //   --capacity <trips>       congested assignment for --assign, with this many trips a day per segment and direction
+    //   --iterations <n>         rounds of the congested assignment (default ASSIGNMENT_ITERATIONS)
+    //   --format <f>             ticket output for --tickets: text (default), json or binary
+    //   --fares <file>           fare rules, see loadFareFile
+    //   --threads <n>            worker threads for --batch and --tickets
+    //   --cache <n>              routes kept in the route cache (default DEFAULT_ROUTE_CACHE_SIZE, 0 disables it)
+    //   --ch                     build a contraction hierarchy for faster point-to-point routes
+    //   --alt [k]                route by A* with k landmarks (default DEFAULT_LANDMARK_COUNT)
+    //   --bidir                  route by bidirectional Dijkstra
+    //   --timetable [file]       build a timetable for ARRIVE/PROFILE queries (settings from file, see loadTimetableFile)
+    //   --disruptions <file>     closed segments and suspended interchanges, see applyDisruption
+    //   --serve <address>        answer queries from clients on a Unix socket path or a local TCP port
+    //   --metrics <file>         write latency and work metrics when done (JSON for *.json, else Prometheus text)
+    //   --bench [sizes]          benchmark every planner on synthetic networks, see parseBenchmarkSizes
+    string networkFile, snapshotFile, writeSnapshotFile, odMatrixFile, writeOdMatrixFile, fareFile, disruptionFile, serveAddress, metricsFile, inputFile;
+    bool batchMode = false;
+    bool ticketMode = false;
+    int isochroneRadius = -1;
+    bool assignMode = false;
+    double capacity = 0;
+    int iterations = ASSIGNMENT_ITERATIONS;
+    TicketFormat ticketFormat = TicketFormat::Text;
+    bool buildHierarchy = false;
+    int landmarkCount = 0;
+    bool buildTimetableLayer = false;
+    string timetableFile;
+    int threads = max(1u, thread::hardware_concurrency());
+    MetroEngine metro;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--network" && hasValue)
+            networkFile = argv[++i];
+        else if (arg == "--snapshot" && hasValue)
+            snapshotFile = argv[++i];
+        else if (arg == "--write-snapshot" && hasValue)
+            writeSnapshotFile = argv[++i];
+        else if (arg == "--write-od-matrix" && hasValue)
+            writeOdMatrixFile = argv[++i];
+        else if (arg == "--od-matrix" && hasValue)
+            odMatrixFile = argv[++i];
+        else if (arg == "--fares" && hasValue)
+            fareFile = argv[++i];
+        else if (arg == "--disruptions" && hasValue)
+            disruptionFile = argv[++i];
+        else if (arg == "--serve" && hasValue)
+            serveAddress = argv[++i];
+        else if (arg == "--metrics" && hasValue)
+            metricsFile = argv[++i];
+        else if (arg == "--format" && hasValue)
+        {
+            string format = argv[++i];
+            if (format == "text")
+                ticketFormat = TicketFormat::Text;
+            else if (format == "json")
+                ticketFormat = TicketFormat::Json;
+            else if (format == "binary")
+                ticketFormat = TicketFormat::Binary;
+            else
+            {
+                cerr << "Unknown ticket format " << format << "\n";
+                return 1;
+            }
+        }
+        else if (arg == "--threads" && hasValue)
+            threads = atoi(argv[++i]);
+        else if (arg == "--cache" && hasValue)
+            metro.setRouteCacheCapacity(max(0, atoi(argv[++i])));
+        else if (arg == "--bench")
+        {
+            string sizes = i + 1 < argc && argv[i + 1][0] != '-' ? argv[++i] : "4x40,16x100,32x250,48x600";
+            vector<SyntheticNetworkSpec> specs;
+            if (!parseBenchmarkSizes(sizes, specs))
+            {
+                cerr << "Bad benchmark sizes " << sizes << "\n";
+                return 1;
+            }
+            metro.runBenchmarks(specs, stdout);
+            return 0;
+        }
+        else if (arg == "--ch")
+            buildHierarchy = true;
+        else if (arg == "--alt")
+            landmarkCount = i + 1 < argc && isdigit((unsigned char)argv[i + 1][0]) ? atoi(argv[++i]) : DEFAULT_LANDMARK_COUNT;
+        else if (arg == "--bidir")
+            metro.setBidirectionalSearch(true);
+        else if (arg == "--timetable")
+        {
+            buildTimetableLayer = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                timetableFile = argv[++i];
+        }
+        else if (arg == "--batch")
+            batchMode = true;
+        else if (arg == "--tickets")
+            ticketMode = true;
+        else if (arg == "--isochrones" && hasValue)
+            isochroneRadius = max(0, atoi(argv[++i]));
+        else if (arg == "--assign")
+            assignMode = true;
+        else if (arg == "--capacity" && hasValue)
+            capacity = max(0.0, atof(argv[++i]));
+        else if (arg == "--iterations" && hasValue)
+            iterations = max(1, atoi(argv[++i]));
+        else if ((batchMode || ticketMode || isochroneRadius >= 0 || assignMode) && inputFile.empty() && arg[0] != '-')
+            inputFile = arg;
+        else
+        {
+            cerr << "Unknown option " << arg << "\n";
+            return 1;
+        }
+    }
+
+    if (!snapshotFile.empty())
+    {
+        if (!metro.loadSnapshot(snapshotFile))
+            return 1;
+    }
+    else if (!networkFile.empty())
+    {
+        if (!metro.loadNetworkFile(networkFile))
+            return 1;
+    }
+    else
+    {
+        metro.loadDefaultNetwork();
     }
 
-    int offset = redLineStations.size();
-    for (int i = 0; i < blueLineStations.size() - 1; ++i) {
-        connect(offset + i, offset + i + 1); // B0-B1...
+    if (buildHierarchy && !metro.hasContractionHierarchy())
+    {
+        metro.buildContractionHierarchy();
     }
 
-    offset += blueLineStations.size();
-    for (int i = 0; i < yellowLineStations.size() - 1; ++i) {
-        connect(offset + i, offset + i + 1); // Y0-Y1...
+    if (landmarkCount > 0)
+    {
+        metro.buildLandmarks(landmarkCount);
     }
 
-    offset += yellowLineStations.size();
-    for (int i = 0; i < pinkLineStations.size() - 1; ++i) {
-        connect(offset + i, offset + i + 1); // P0-P1...
+    if (!writeSnapshotFile.empty())
+    {
+        return metro.writeSnapshot(writeSnapshotFile) ? 0 : 1;
     }
 
-    vector<string> interchanges = {
-        "Azadpur",
-        "Kashmere Gate",
-        "Rajiv Chowk",
-        "Welcome",
-        "Yamuna Bank",
-        "Mandi House",
-        "Central Secretariat",
-        "Anand Vihar",
-        "Mayur Vihar Phase-1",
-        "INA"};
-
-    for (const auto &s : interchanges) {
-        addInterchange(s);
+    if (!fareFile.empty() && !metro.loadFareFile(fareFile))
+    {
+        return 1;
     }
 
-    menu();
-    return 0;
-}
\ No newline at end of file
+    if (buildTimetableLayer && !metro.buildTimetable(timetableFile))
+    {
+        return 1;
+    }
+
+    if (!disruptionFile.empty() && !metro.loadDisruptionFile(disruptionFile))
+    {
+        return 1;
+    }
+
+    if (!writeOdMatrixFile.empty())
+    {
+        return metro.writeOdMatrix(writeOdMatrixFile, threads) ? 0 : 1;
+    }
+
+    if (!odMatrixFile.empty() && !metro.loadOdMatrix(odMatrixFile))
+    {
+        return 1;
+    }
+
+    if (!serveAddress.empty())
+    {
+        return metro.serve(serveAddress, threads);
+    }
+
+    if (batchMode || ticketMode || isochroneRadius >= 0 || assignMode)
+    {
+        ios::sync_with_stdio(false);
+        ifstream file;
+        if (!inputFile.empty() && inputFile != "-")
+        {
+            file.open(inputFile);
+            if (!file)
+            {
+                cerr << "Cannot open " << inputFile << "\n";
+                return 1;
+            }
+        }
+        istream &in = file.is_open() ? static_cast<istream &>(file) : cin;
+
+        if (ticketMode)
+            metro.runTicketIssuing(in, stdout, threads, ticketFormat);
+        else if (isochroneRadius >= 0)
+            metro.runIsochrones(in, stdout, isochroneRadius, threads);
+        else if (assignMode)
+        {
+            if (!metro.runAssignment(in, stdout, threads, capacity, iterations))
+                return 1;
+        }
+        else
+            metro.runBatch(in, stdout, threads);
+    }
+    else
+    {
+        menu(metro);
+    }
+
+    return metricsFile.empty() || metro.writeMetricsFile(metricsFile) ? 0 : 1;
+}
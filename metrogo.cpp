@@ -0,0 +1,6249 @@
+#include "metrogo.h"
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <queue>
+#include <map>
+#include <set>
+#include <bitset>
+#include <unordered_map>
+#include <string_view>
+#include <iomanip>
+#include <algorithm>
+#include <functional>
+#include <climits>
+#include <limits>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <cmath>
+#include <cerrno>
+#include <csignal>
+#include <memory>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Everything but the MetroEngine methods and the functions declared in
+// metrogo.h is internal, so no helper or global can clash with a name in
+// the program linking the library.
+namespace
+{
+
+// Read-only view of consecutive ids, valid as long as the array it points into
+struct IdSpan
+{
+    const int *first = nullptr;
+    size_t count = 0;
+
+    IdSpan() = default;
+    IdSpan(const int *first, size_t count) : first(first), count(count) {}
+    IdSpan(const vector<int> &ids) : first(ids.data()), count(ids.size()) {}
+
+    const int *begin() const { return first; }
+    const int *end() const { return first + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    int operator[](size_t i) const { return first[i]; }
+    int front() const { return first[0]; }
+    int back() const { return first[count - 1]; }
+};
+
+// Stations and nodes with dense integer ids. A station id is given to every
+// distinct name in order of first appearance; a node is one station on one
+// line, numbered in the order the lines are added. Each name is stored once
+// in a character arena and found through an open-addressing hash table, so
+// lookups never compare more than the probed names.
+struct StationTable
+{
+    string nameArena;                  // all station names back to back
+    vector<uint32_t> nameOffsets = {0}; // station id -> start of its name; one extra entry at the end
+    vector<int> hashSlots;             // station id or -1, size is a power of two
+
+    vector<int> nodeStation; // node -> station id
+    vector<char> nodeLine;   // node -> line prefix
+
+    // Nodes of every station in ascending order (CSR), rebuilt by indexNodes()
+    vector<int> stationNodeOffsets;
+    vector<int> stationNodeList;
+
+    int stationCount() const { return (int)nameOffsets.size() - 1; }
+    int nodeCount() const { return nodeStation.size(); }
+
+    string_view name(int station) const
+    {
+        return string_view(nameArena).substr(nameOffsets[station], nameOffsets[station + 1] - nameOffsets[station]);
+    }
+
+    IdSpan nodesOf(int station) const
+    {
+        return IdSpan(stationNodeList.data() + stationNodeOffsets[station],
+                      stationNodeOffsets[station + 1] - stationNodeOffsets[station]);
+    }
+
+    bool nodesIndexed() const { return stationNodeOffsets.size() == nameOffsets.size() && stationNodeList.size() == nodeStation.size(); }
+
+    static uint64_t hash(string_view s)
+    {
+        // FNV-1a
+        uint64_t h = 1469598103934665603ull;
+        for (char c : s)
+            h = (h ^ (unsigned char)c) * 1099511628211ull;
+        return h;
+    }
+
+    // Station id of a name, or -1
+    int find(string_view s) const
+    {
+        if (hashSlots.empty())
+            return -1;
+        size_t mask = hashSlots.size() - 1;
+        for (size_t slot = hash(s) & mask;; slot = (slot + 1) & mask)
+        {
+            int station = hashSlots[slot];
+            if (station == -1 || name(station) == s)
+                return station;
+        }
+    }
+
+    // Station id of a name, adding the station if it is new
+    int intern(string_view s)
+    {
+        int station = find(s);
+        if (station != -1)
+            return station;
+
+        station = stationCount();
+        nameArena.append(s);
+        nameOffsets.push_back(nameArena.size());
+
+        // Keep the table at most half full
+        if ((size_t)stationCount() * 2 > hashSlots.size())
+            rehash(max<size_t>(16, hashSlots.size() * 2));
+        else
+            insertSlot(station);
+        return station;
+    }
+
+    void rehash(size_t slots)
+    {
+        hashSlots.assign(slots, -1);
+        for (int station = 0; station < stationCount(); ++station)
+            insertSlot(station);
+    }
+
+    void insertSlot(int station)
+    {
+        size_t mask = hashSlots.size() - 1;
+        size_t slot = hash(name(station)) & mask;
+        while (hashSlots[slot] != -1)
+            slot = (slot + 1) & mask;
+        hashSlots[slot] = station;
+    }
+
+    // Counting sort of the nodes by station, keeping node order within a station
+    void indexNodes()
+    {
+        int stations = stationCount();
+        stationNodeOffsets.assign(stations + 1, 0);
+        for (int station : nodeStation)
+            stationNodeOffsets[station + 1]++;
+        for (int s = 0; s < stations; ++s)
+            stationNodeOffsets[s + 1] += stationNodeOffsets[s];
+
+        stationNodeList.resize(nodeStation.size());
+        vector<int> fill(stationNodeOffsets.begin(), stationNodeOffsets.end() - 1);
+        for (int node = 0; node < nodeCount(); ++node)
+            stationNodeList[fill[nodeStation[node]]++] = node;
+    }
+};
+
+// Compressed sparse row adjacency: the neighbours of node u are
+// targets[offsets[u]] .. targets[offsets[u + 1] - 1], with matching weights
+struct CsrGraph
+{
+    vector<int> offsets;
+    vector<int> targets;
+    vector<int> weights;        // CLOSED_EDGE while a disruption closes the edge
+    vector<int> plannedWeights; // weights as built, saved on the first disruption
+
+    int size() const { return offsets.empty() ? 0 : (int)offsets.size() - 1; }
+};
+
+// Weight of an edge closed by a disruption; every search skips it
+const int CLOSED_EDGE = INT_MAX;
+
+// Contraction hierarchy over the node graph, interchange edges included.
+// Nodes are contracted one at a time; contracting v adds a shortcut u-x for
+// every pair of its remaining neighbours whose shortest connection runs
+// through v. A query then only has to search "upwards" in rank from both
+// ends, which settles a small fraction of the graph.
+struct ContractionHierarchy
+{
+    vector<int> rank; // position of every node in the contraction order
+
+    // Edges from every node to its neighbours of higher rank, in CSR layout.
+    // upMiddle is the node a shortcut bypasses, or -1 for an original edge.
+    vector<int> upOffsets;
+    vector<int> upTargets;
+    vector<int> upWeights;
+    vector<int> upMiddle;
+
+    bool empty() const { return rank.empty(); }
+};
+
+// Landmark distance tables for A* with ALT lower bounds. By the triangle
+// inequality, d(v, t) >= |d(L, t) - d(L, v)| for every landmark L, which
+// steers the search towards the target without ever overestimating.
+struct LandmarkTable
+{
+    vector<int> landmarks; // node ids
+    vector<int> dist;      // node-major: dist[v * landmarks.size() + i] is d(landmark i, v)
+    vector<int> parent;    // same layout: v's predecessor in the shortest path tree of landmark i
+
+    bool empty() const { return landmarks.empty(); }
+};
+
+// Everything the route searches read that changes after start-up, as
+// disruptions change weights, repair the landmark tables and drop the
+// hierarchy. Loading, building and disruptions work on the engine's
+// liveRouting; the searches read the state the calling thread routes on,
+// which is liveRouting unless a server worker has pinned a published copy
+// (see RoutingPin), so they never see a half-applied change.
+struct RoutingState
+{
+    CsrGraph graph;
+    ContractionHierarchy hierarchy;
+    LandmarkTable landmarkTable;
+
+    // Bumped whenever the graph, the hierarchy or the fare rules change,
+    // so routes cached under an older version are never served
+    uint64_t version = 1;
+};
+
+// Edges collected by connect() until buildGraph() packs them into the CSR arrays
+struct PendingEdge
+{
+    int from;
+    int to;
+    int weight;
+};
+
+// Prebuilt index for station name autocomplete. Every distinct station name
+// is stored once in lower case; an alphabetical order answers prefix queries
+// and a suffix array over all names answers substring queries, both by
+// binary search. Every name also has a bigram signature for the fuzzy search.
+struct StationSearchIndex
+{
+    string text;             // lower-case names in station id order, each followed by '\n'
+    vector<int> nameStart;   // offset of each station's name in text
+    vector<int> byName;      // station ids in alphabetical order
+    vector<int> suffixes;    // text offsets sorted by the suffix starting there
+    vector<int> posToName;   // station id for every text offset
+    vector<uint64_t> bigrams; // station id -> bigramSignature() of its name
+};
+
+
+// Fare rules. A fare is worked out in paise so rounding never drifts:
+//   1. the first slab whose upToKm covers the distance gives
+//      flatPaise + paisePerKm * distance
+//   2. the first time period containing the travel time scales it by percent
+//   3. the result is kept between minimumPaise and capPaise
+// The defaults are the original Rs. 5 per KM capped at Rs. 60.
+struct FareSlab
+{
+    int upToKm;
+    int flatPaise;
+    int paisePerKm;
+};
+
+struct FarePeriod
+{
+    int fromMinute; // minutes after midnight, inclusive
+    int toMinute;   // exclusive; a period may wrap past midnight
+    int percent;    // 100 = unchanged
+};
+
+struct FareRules
+{
+    vector<FareSlab> slabs = {{INT_MAX, 0, 500}};
+    vector<FarePeriod> periods;
+    int minimumPaise = 0;
+    int capPaise = 6000;
+};
+
+
+// Instrumentation of the public operations: a latency histogram per
+// operation and the work its queries did, exported on demand as Prometheus
+// text or JSON (see METRICS queries and --metrics). Build with
+// -DMETROGO_METRICS=0 to compile all of it out.
+#ifndef METROGO_METRICS
+#define METROGO_METRICS 1
+#endif
+
+// Nodes settled by the searches on this thread, for comparing search
+// strategies; kept without METROGO_METRICS too, as --bench reports it
+thread_local long long settledNodes = 0;
+
+#if METROGO_METRICS
+// Work done by the searches on this thread. An operation records how much
+// these grew while it ran, so work done on helper threads is not counted.
+struct WorkCounters
+{
+    long long edgesRelaxed = 0;
+    long long heapPushes = 0;
+    long long nameComparisons = 0;
+};
+thread_local WorkCounters workCounters;
+
+#define COUNT_WORK(counter, amount) (workCounters.counter += (amount))
+
+enum class Operation
+{
+    Search,
+    Dijkstra,
+    ShortestPath,
+    IssueTicket,
+    MeetingPoints,
+    Tsp,
+    HeuristicTsp,
+    AlternativeRoutes,
+    ParetoRoutes,
+    FuzzySearch,
+    ReachableStations,
+    ReachableFromEach,
+    AssignFlows,
+    Count
+};
+
+// Names as exported, matching the --bench operations where there is one
+const char *const OPERATION_NAMES[] = {"search", "dijkstra", "getShortestPath", "issueTicket",
+                                       "findMeetingPoints", "tsp", "heuristicTsp", "alternativeRoutes",
+                                       "paretoRoutes", "fuzzySearch", "reachableStations", "reachableFromEach",
+                                       "assignFlows"};
+
+// Latency buckets are powers of two: bucket i counts calls that took less
+// than 2^(i + 8) ns, from 256 ns up to about 1 s, and the last one the rest
+const int LATENCY_BUCKETS = 24;
+
+struct OperationMetrics
+{
+    atomic<uint64_t> buckets[LATENCY_BUCKETS] = {};
+    atomic<uint64_t> calls{0};
+    atomic<uint64_t> totalNs{0};
+    atomic<uint64_t> nodesSettled{0};
+    atomic<uint64_t> edgesRelaxed{0};
+    atomic<uint64_t> heapPushes{0};
+    atomic<uint64_t> nameComparisons{0};
+};
+
+#endif
+
+class RouteCache;
+struct Timetable;
+class OdMatrix;
+
+} // namespace
+
+// Everything one MetroEngine owns. The functions below work on the engine
+// current on the calling thread (see EngineScope), so a process can hold
+// any number of engines; the thread_local scratch buffers of the searches
+// are shared by all of them.
+struct EngineState
+{
+    StationTable stations;
+    RoutingState liveRouting;
+    vector<PendingEdge> pendingEdges;
+    StationSearchIndex searchIndex;
+    FareRules fareRules;
+
+    // Route with bidirectionalRoute() when there is no hierarchy or landmark table
+    bool bidirectionalSearch = false;
+
+    unique_ptr<RouteCache> routeCache;
+    unique_ptr<Timetable> timetable;
+    unique_ptr<OdMatrix> odMatrix;
+
+    // Copy of liveRouting that server workers route on, see publishRouting()
+    shared_ptr<const RoutingState> publishedRouting;
+
+#if METROGO_METRICS
+    OperationMetrics operationMetrics[(int)Operation::Count];
+#endif
+
+    EngineState();
+    ~EngineState();
+};
+
+namespace
+{
+
+// The engine of the calling thread, and the routing state its searches
+// read: engine->liveRouting unless a server worker has pinned a published
+// copy (see RoutingPin)
+thread_local EngineState *engine = nullptr;
+thread_local const RoutingState *routing = nullptr;
+
+// Makes an engine current on this thread until the scope ends, then
+// restores the one before
+class EngineScope
+{
+public:
+    explicit EngineScope(EngineState &state) : savedEngine(engine), savedRouting(routing)
+    {
+        engine = &state;
+        routing = &state.liveRouting;
+    }
+
+    ~EngineScope()
+    {
+        engine = savedEngine;
+        routing = savedRouting;
+    }
+
+    EngineScope(const EngineScope &) = delete;
+    EngineScope &operator=(const EngineScope &) = delete;
+
+private:
+    EngineState *savedEngine;
+    const RoutingState *savedRouting;
+};
+
+int findStation(string_view name)
+{
+    return engine->stations.find(name);
+}
+
+string_view stationName(int station)
+{
+    return engine->stations.name(station);
+}
+
+// Name of the station a node belongs to
+string_view nodeName(int node)
+{
+    return engine->stations.name(engine->stations.nodeStation[node]);
+}
+
+int nodeCount()
+{
+    return engine->stations.nodeCount();
+}
+
+// Nodes of a station (one per line it is on)
+IdSpan stationNodes(int station)
+{
+    return engine->stations.nodesOf(station);
+}
+
+void addNodes(const vector<string> &line, char prefix)
+{
+    for (size_t i = 0; i < line.size(); ++i)
+    {
+        engine->stations.nodeStation.push_back(engine->stations.intern(line[i]));
+        engine->stations.nodeLine.push_back(prefix);
+    }
+}
+
+void initializeGraph()
+{
+    engine->pendingEdges.clear();
+    engine->liveRouting.graph = CsrGraph();
+    engine->liveRouting.hierarchy = ContractionHierarchy();
+    engine->liveRouting.landmarkTable = LandmarkTable();
+    engine->liveRouting.version++;
+}
+
+// Forgets the network and everything built for it, see below Timetable
+void clearNetwork();
+
+// Packs all connect()/addInterchange() calls into the CSR graph.
+// A later connect() on the same pair overrides the earlier weight, and
+// weights <= 0 mean "no edge", same as the old adjacency matrix.
+void buildGraph()
+{
+    CsrGraph &graph = engine->liveRouting.graph;
+    int n = nodeCount();
+    engine->stations.indexNodes();
+
+    // Stable sort keeps the call order within a pair, so the last call wins
+    stable_sort(engine->pendingEdges.begin(), engine->pendingEdges.end(), [](const PendingEdge &a, const PendingEdge &b)
+                { return a.from != b.from ? a.from < b.from : a.to < b.to; });
+
+    graph.offsets.assign(n + 1, 0);
+    graph.targets.clear();
+    graph.weights.clear();
+
+    for (size_t i = 0; i < engine->pendingEdges.size(); ++i)
+    {
+        const PendingEdge &e = engine->pendingEdges[i];
+        bool lastOfPair = i + 1 == engine->pendingEdges.size() || engine->pendingEdges[i + 1].from != e.from || engine->pendingEdges[i + 1].to != e.to;
+        if (!lastOfPair || e.weight <= 0)
+            continue;
+
+        graph.targets.push_back(e.to);
+        graph.weights.push_back(e.weight);
+        graph.offsets[e.from + 1]++;
+    }
+
+    for (int u = 0; u < n; ++u)
+        graph.offsets[u + 1] += graph.offsets[u];
+
+    engine->pendingEdges.clear();
+    engine->pendingEdges.shrink_to_fit();
+    engine->liveRouting.version++;
+}
+
+// void connect(int i, int j) {
+//     adjMatrix[i][j] = 1;
+//     adjMatrix[j][i] = 1; // undirected
+// }
+
+#if METROGO_METRICS
+// Records one call of an operation when it goes out of scope. Relaxed
+// atomic adds only, so threads never wait for each other here.
+class OperationTimer
+{
+public:
+    explicit OperationTimer(Operation op)
+        : metrics(engine->operationMetrics[(int)op]), start(chrono::steady_clock::now()),
+          settledAtStart(settledNodes), workAtStart(workCounters) {}
+
+    ~OperationTimer()
+    {
+        uint64_t ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+        int bucket = 0;
+        while (bucket < LATENCY_BUCKETS - 1 && ns >= (256ull << bucket))
+            bucket++;
+
+        auto add = [](atomic<uint64_t> &total, uint64_t amount)
+        { total.fetch_add(amount, memory_order_relaxed); };
+        add(metrics.buckets[bucket], 1);
+        add(metrics.calls, 1);
+        add(metrics.totalNs, ns);
+        add(metrics.nodesSettled, settledNodes - settledAtStart);
+        add(metrics.edgesRelaxed, workCounters.edgesRelaxed - workAtStart.edgesRelaxed);
+        add(metrics.heapPushes, workCounters.heapPushes - workAtStart.heapPushes);
+        add(metrics.nameComparisons, workCounters.nameComparisons - workAtStart.nameComparisons);
+    }
+
+    OperationTimer(const OperationTimer &) = delete;
+    OperationTimer &operator=(const OperationTimer &) = delete;
+
+private:
+    OperationMetrics &metrics;
+    chrono::steady_clock::time_point start;
+    long long settledAtStart;
+    WorkCounters workAtStart;
+};
+
+#define TIME_OPERATION(op) OperationTimer operationTimer(op)
+
+// Upper bound of a latency bucket in ns; the last bucket has none
+uint64_t latencyBucketBound(int bucket)
+{
+    return 256ull << bucket;
+}
+
+// Latency below which the given fraction of calls fell, as a bucket bound
+// (0 before the first call)
+uint64_t latencyPercentile(const OperationMetrics &metrics, double q)
+{
+    uint64_t calls = metrics.calls.load(memory_order_relaxed);
+    if (calls == 0)
+        return 0;
+    uint64_t seen = 0;
+    for (int b = 0; b < LATENCY_BUCKETS - 1; ++b)
+    {
+        seen += metrics.buckets[b].load(memory_order_relaxed);
+        if (seen > 0 && seen >= q * calls)
+            return latencyBucketBound(b);
+    }
+    return latencyBucketBound(LATENCY_BUCKETS - 1);
+}
+
+// All operations on one line of JSON, with p50/p99 read off the histogram
+string metricsJson()
+{
+    string out = "{\"operations\":[";
+    for (int op = 0; op < (int)Operation::Count; ++op)
+    {
+        const OperationMetrics &m = engine->operationMetrics[op];
+        char line[512];
+        snprintf(line, sizeof(line),
+                 "%s{\"op\":\"%s\",\"calls\":%llu,\"total_ns\":%llu,\"p50_ns\":%llu,\"p99_ns\":%llu,"
+                 "\"nodes_settled\":%llu,\"edges_relaxed\":%llu,\"heap_pushes\":%llu,\"name_comparisons\":%llu,\"buckets\":[",
+                 op ? "," : "", OPERATION_NAMES[op],
+                 (unsigned long long)m.calls.load(), (unsigned long long)m.totalNs.load(),
+                 (unsigned long long)latencyPercentile(m, 0.50), (unsigned long long)latencyPercentile(m, 0.99),
+                 (unsigned long long)m.nodesSettled.load(), (unsigned long long)m.edgesRelaxed.load(),
+                 (unsigned long long)m.heapPushes.load(), (unsigned long long)m.nameComparisons.load());
+        out += line;
+        for (int b = 0; b < LATENCY_BUCKETS; ++b)
+            out += (b ? "," : "") + to_string(m.buckets[b].load());
+        out += "]}";
+    }
+    out += "]}";
+    return out;
+}
+
+// Prometheus text exposition: a latency histogram and work counters per
+// operation, ending with "# EOF" as in OpenMetrics
+string metricsPrometheus()
+{
+    string out = "# HELP metrogo_operation_seconds Latency of public operations\n"
+                 "# TYPE metrogo_operation_seconds histogram\n";
+    char line[256];
+    for (int op = 0; op < (int)Operation::Count; ++op)
+    {
+        const OperationMetrics &m = engine->operationMetrics[op];
+        uint64_t cumulative = 0;
+        for (int b = 0; b < LATENCY_BUCKETS - 1; ++b)
+        {
+            cumulative += m.buckets[b].load();
+            snprintf(line, sizeof(line), "metrogo_operation_seconds_bucket{op=\"%s\",le=\"%.9g\"} %llu\n",
+                     OPERATION_NAMES[op], latencyBucketBound(b) / 1e9, (unsigned long long)cumulative);
+            out += line;
+        }
+        snprintf(line, sizeof(line),
+                 "metrogo_operation_seconds_bucket{op=\"%s\",le=\"+Inf\"} %llu\n"
+                 "metrogo_operation_seconds_sum{op=\"%s\"} %.9f\n"
+                 "metrogo_operation_seconds_count{op=\"%s\"} %llu\n",
+                 OPERATION_NAMES[op], (unsigned long long)m.calls.load(),
+                 OPERATION_NAMES[op], m.totalNs.load() / 1e9,
+                 OPERATION_NAMES[op], (unsigned long long)m.calls.load());
+        out += line;
+    }
+
+    out += "# HELP metrogo_work_total Work done by public operations, including nested ones\n"
+           "# TYPE metrogo_work_total counter\n";
+    for (int op = 0; op < (int)Operation::Count; ++op)
+    {
+        const OperationMetrics &m = engine->operationMetrics[op];
+        pair<const char *, const atomic<uint64_t> *> counters[] = {
+            {"nodes_settled", &m.nodesSettled},
+            {"edges_relaxed", &m.edgesRelaxed},
+            {"heap_pushes", &m.heapPushes},
+            {"name_comparisons", &m.nameComparisons}};
+        for (const auto &counter : counters)
+        {
+            snprintf(line, sizeof(line), "metrogo_work_total{op=\"%s\",counter=\"%s\"} %llu\n",
+                     OPERATION_NAMES[op], counter.first, (unsigned long long)counter.second->load());
+            out += line;
+        }
+    }
+    out += "# EOF";
+    return out;
+}
+
+// Writes the metrics when --batch, --tickets or the menu ends: JSON if
+// the file name ends in .json, Prometheus text otherwise
+bool writeMetricsFile(const string &fileName)
+{
+    bool json = fileName.size() >= 5 && fileName.compare(fileName.size() - 5, 5, ".json") == 0;
+    ofstream out(fileName);
+    out << (json ? metricsJson() : metricsPrometheus()) << "\n";
+    if (!out)
+    {
+        cerr << "Cannot write " << fileName << "\n";
+        return false;
+    }
+    return true;
+}
+#else
+#define COUNT_WORK(counter, amount) ((void)0)
+#define TIME_OPERATION(op) ((void)0)
+
+bool writeMetricsFile(const string &fileName)
+{
+    cerr << "Built without metrics (METROGO_METRICS=0), not writing " << fileName << "\n";
+    return false;
+}
+#endif
+
+string toLowerCase(string_view s)
+{
+    string out(s);
+    for (char &c : out)
+        c = tolower((unsigned char)c);
+    return out;
+}
+
+// One bit (of 64) for every pair of adjacent characters in s
+uint64_t bigramSignature(string_view s)
+{
+    uint64_t signature = 0;
+    for (size_t i = 1; i < s.size(); ++i)
+    {
+        uint32_t pair = (unsigned char)s[i - 1] << 8 | (unsigned char)s[i];
+        signature |= 1ull << ((pair * 0x9E3779B1u) >> 26);
+    }
+    return signature;
+}
+
+void buildSearchIndex()
+{
+    StationSearchIndex index;
+
+    for (int station = 0; station < engine->stations.stationCount(); ++station)
+    {
+        index.nameStart.push_back(index.text.size());
+        index.text += toLowerCase(stationName(station));
+        index.text += '\n';
+    }
+
+    int names = index.nameStart.size();
+    string_view text = index.text;
+    auto nameOf = [&](int i)
+    { return text.substr(index.nameStart[i], text.find('\n', index.nameStart[i]) - index.nameStart[i]); };
+
+    index.byName.resize(names);
+    for (int i = 0; i < names; ++i)
+        index.byName[i] = i;
+    sort(index.byName.begin(), index.byName.end(), [&](int a, int b)
+         { return nameOf(a) < nameOf(b); });
+
+    index.posToName.resize(text.size());
+    for (int i = 0; i < names; ++i)
+    {
+        for (size_t pos = index.nameStart[i]; text[pos] != '\n'; ++pos)
+        {
+            index.posToName[pos] = i;
+            index.suffixes.push_back(pos);
+        }
+        index.posToName[text.find('\n', index.nameStart[i])] = i;
+        index.bigrams.push_back(bigramSignature(nameOf(i)));
+    }
+    sort(index.suffixes.begin(), index.suffixes.end(), [&](int a, int b)
+         { return text.substr(a) < text.substr(b); });
+
+    engine->searchIndex = move(index);
+}
+
+// Case-insensitive substring search over station names. Returns at most
+// limit station ids without duplicates: names starting with the query come
+// first (alphabetically), then names that contain it elsewhere.
+vector<int> searchStations(const string &query, size_t limit)
+{
+    TIME_OPERATION(Operation::Search);
+    const StationSearchIndex &index = engine->searchIndex;
+    string pattern = toLowerCase(query);
+    vector<int> found;
+    if (pattern.empty() || limit == 0)
+        return found;
+
+    string_view text = index.text;
+    size_t m = pattern.size();
+
+    // Prefix matches
+    auto prefixFirst = lower_bound(index.byName.begin(), index.byName.end(), pattern, [&](int i, const string &p)
+                                   { COUNT_WORK(nameComparisons, 1); return text.substr(index.nameStart[i], m) < p; });
+    for (auto it = prefixFirst; it != index.byName.end() && found.size() < limit; ++it)
+    {
+        COUNT_WORK(nameComparisons, 1);
+        if (text.substr(index.nameStart[*it], m) != pattern)
+            break;
+        found.push_back(*it);
+    }
+
+    // Matches further inside a name; suffixes at a name start were taken above
+    auto substrFirst = lower_bound(index.suffixes.begin(), index.suffixes.end(), pattern, [&](int pos, const string &p)
+                                   { COUNT_WORK(nameComparisons, 1); return text.substr(pos, m) < p; });
+    for (auto it = substrFirst; it != index.suffixes.end() && found.size() < limit; ++it)
+    {
+        COUNT_WORK(nameComparisons, 1);
+        if (text.substr(*it, m) != pattern)
+            break;
+
+        int station = index.posToName[*it];
+        if (index.nameStart[station] == *it)
+            continue;
+
+        if (find(found.begin(), found.end(), station) == found.end())
+            found.push_back(station);
+    }
+
+    return found;
+}
+
+// Longest query the fuzzy search looks at; it fits one machine word
+const size_t FUZZY_PATTERN_LIMIT = 64;
+
+// Typos allowed in a query of n characters: one per FUZZY_CHARS_PER_ERROR,
+// at most FUZZY_MAX_ERRORS
+const int FUZZY_CHARS_PER_ERROR = 4;
+const int FUZZY_MAX_ERRORS = 3;
+
+// Typo-tolerant search: station names containing the query (case-insensitive,
+// only the first FUZZY_PATTERN_LIMIT characters) with at most maxErrors
+// insertions, deletions or substitutions, best first and alphabetically
+// among equals. A negative maxErrors takes the bound from the query length.
+//
+// Each name is scored with Myers' bit-parallel edit distance: one 64-bit
+// word holds a column of the dynamic programming table, so a name costs a
+// dozen word operations per character. A name is only scored if its bigram
+// signature passes the q-gram test: every edit breaks at most two bigrams
+// of the query, so a name that misses more than 2 * maxErrors of the
+// query's bigrams cannot match.
+vector<FuzzyMatch> fuzzySearchStations(const string &query, size_t limit, int maxErrors = -1)
+{
+    TIME_OPERATION(Operation::FuzzySearch);
+    const StationSearchIndex &index = engine->searchIndex;
+    string pattern = toLowerCase(query).substr(0, FUZZY_PATTERN_LIMIT);
+    vector<FuzzyMatch> found;
+    if (pattern.empty() || limit == 0)
+        return found;
+
+    int m = pattern.size();
+    if (maxErrors < 0)
+        maxErrors = min(FUZZY_MAX_ERRORS, m / FUZZY_CHARS_PER_ERROR);
+
+    // Bit i of matchMask[c] is set where pattern[i] == c
+    uint64_t matchMask[256] = {};
+    for (int i = 0; i < m; ++i)
+        matchMask[(unsigned char)pattern[i]] |= 1ull << i;
+    uint64_t last = 1ull << (m - 1);
+    uint64_t patternBigrams = bigramSignature(pattern);
+
+    string_view text = index.text;
+    for (int station : index.byName)
+    {
+        // Names end with '\n', so the next one starts a character later
+        size_t nameEnd = station + 1 < (int)index.nameStart.size() ? index.nameStart[station + 1] - 1 : text.size() - 1;
+        int length = nameEnd - index.nameStart[station];
+        if (length < m - maxErrors || (int)bitset<64>(patternBigrams & ~index.bigrams[station]).count() > 2 * maxErrors)
+            continue;
+        COUNT_WORK(nameComparisons, 1);
+
+        // Vertical deltas of the current column as +1 and -1 bit vectors; the
+        // top row stays 0 so the query may start anywhere in the name. The
+        // score drops by at most one per character, so the scan stops once
+        // the rest of the name cannot bring it within the bound.
+        uint64_t plus = ~0ull, minus = 0;
+        int score = m, best = m;
+        for (size_t pos = index.nameStart[station]; pos < nameEnd && score - (int)(nameEnd - pos) <= maxErrors; ++pos)
+        {
+            uint64_t eq = matchMask[(unsigned char)text[pos]];
+            uint64_t xv = eq | minus;
+            uint64_t xh = (((eq & plus) + plus) ^ plus) | eq;
+            uint64_t hPlus = minus | ~(xh | plus);
+            uint64_t hMinus = plus & xh;
+            if (hPlus & last)
+                score++;
+            else if (hMinus & last)
+                score--;
+            hPlus <<= 1;
+            hMinus <<= 1;
+            plus = hMinus | ~(xv | hPlus);
+            minus = hPlus & xv;
+            best = min(best, score);
+        }
+        if (best <= maxErrors)
+            found.push_back({station, best});
+    }
+
+    stable_sort(found.begin(), found.end(), [](const FuzzyMatch &a, const FuzzyMatch &b)
+                { return a.errors < b.errors; });
+    if (found.size() > limit)
+        found.resize(limit);
+    return found;
+}
+
+// Modified connect function to take weight (default is 1)
+// Edges are only recorded here, buildGraph() turns them into the CSR graph
+void connect(int i, int j, int weight = 1)
+{
+    engine->pendingEdges.push_back({i, j, weight});
+    engine->pendingEdges.push_back({j, i, weight}); // undirected
+}
+
+// Dijkstra over the CSR graph with a binary heap, seeded with every node in
+// sources at distance 0. If targets is not empty the search stops as soon as
+// one of them is settled and returns it (-1 if none is reachable); dist and
+// prev are then final only for settled nodes, which include the whole path
+// to the returned target. With no targets the whole graph is settled.
+// If order is given it receives the settled nodes in the order they settled.
+int dijkstraToAny(IdSpan sources, IdSpan targets, vector<int> &dist, vector<int> &prev, vector<int> *order = nullptr)
+{
+    const CsrGraph &graph = routing->graph;
+    int n = graph.size();
+    dist.assign(n, INT_MAX);
+    prev.assign(n, -1);
+    if (order)
+        order->clear();
+
+    // Targets are marked with a per-call stamp so clearing them is free,
+    // except once every 2^32 calls when the stamp wraps around
+    thread_local vector<unsigned> targetMark;
+    thread_local unsigned stamp = 0;
+    if (targetMark.size() != (size_t)n)
+    {
+        targetMark.assign(n, 0);
+        stamp = 0;
+    }
+    if (++stamp == 0)
+    {
+        fill(targetMark.begin(), targetMark.end(), 0);
+        stamp = 1;
+    }
+    for (int t : targets)
+        targetMark[t] = stamp;
+
+    // Heap entries are {distance, node}; ties pop the smaller node index first,
+    // which settles nodes in the same order as a linear minimum scan.
+    // The heap storage is per thread and reused across calls.
+    thread_local vector<pair<int, int>> heap;
+    greater<pair<int, int>> cmp;
+    heap.clear();
+
+    for (int src : sources)
+    {
+        if (dist[src] == 0)
+            continue;
+        dist[src] = 0;
+        COUNT_WORK(heapPushes, 1);
+        heap.push_back({0, src});
+        push_heap(heap.begin(), heap.end(), cmp);
+    }
+
+    while (!heap.empty())
+    {
+        pop_heap(heap.begin(), heap.end(), cmp);
+        int d = heap.back().first;
+        int u = heap.back().second;
+        heap.pop_back();
+
+        // Skip stale entries left behind by a later improvement
+        if (d > dist[u])
+            continue;
+        settledNodes++;
+        COUNT_WORK(edgesRelaxed, graph.offsets[u + 1] - graph.offsets[u]);
+        if (order)
+            order->push_back(u);
+
+        if (targetMark[u] == stamp)
+            return u;
+
+        for (int e = graph.offsets[u]; e < graph.offsets[u + 1]; ++e)
+        {
+            // Summed in 64 bits, so a CLOSED_EDGE never relaxes anything
+            int v = graph.targets[e];
+            long long newDist = (long long)d + graph.weights[e];
+            if (newDist < dist[v])
+            {
+                dist[v] = newDist;
+                prev[v] = u;
+                COUNT_WORK(heapPushes, 1);
+                heap.push_back({dist[v], v});
+                push_heap(heap.begin(), heap.end(), cmp);
+            }
+        }
+    }
+
+    return -1;
+}
+
+// Single-source Dijkstra over the whole graph
+void dijkstra(int src, vector<int> &dist, vector<int> &prev)
+{
+    TIME_OPERATION(Operation::Dijkstra);
+    dijkstraToAny(IdSpan(&src, 1), IdSpan(), dist, prev);
+}
+
+// Nodes a witness search may settle before giving up; giving up early only
+// adds a redundant shortcut, never a wrong distance
+const int WITNESS_SETTLE_LIMIT = 500;
+
+void buildContractionHierarchy()
+{
+    const CsrGraph &graph = engine->liveRouting.graph;
+    int n = graph.size();
+
+    // Remaining graph, at most one arc per neighbour
+    struct Arc
+    {
+        int to;
+        int weight;
+        int middle;
+    };
+    vector<vector<Arc>> adj(n);
+    for (int u = 0; u < n; ++u)
+        for (int e = graph.offsets[u]; e < graph.offsets[u + 1]; ++e)
+            if (graph.weights[e] != CLOSED_EDGE)
+                adj[u].push_back({graph.targets[e], graph.weights[e], -1});
+
+    vector<bool> contracted(n, false);
+    vector<int> deletedNeighbours(n, 0);
+    vector<vector<Arc>> up(n);
+    ContractionHierarchy ch;
+    ch.rank.assign(n, -1);
+
+    // Local Dijkstra from one neighbour that avoids the node being contracted
+    vector<int> witnessDist(n, INT_MAX);
+    vector<int> touched;
+    vector<pair<int, int>> heap;
+    greater<pair<int, int>> cmp;
+    auto witnessSearch = [&](int from, int skip, int limit)
+    {
+        for (int t : touched)
+            witnessDist[t] = INT_MAX;
+        touched.clear();
+        heap.clear();
+
+        witnessDist[from] = 0;
+        touched.push_back(from);
+        heap.push_back({0, from});
+        int settled = 0;
+
+        while (!heap.empty() && settled < WITNESS_SETTLE_LIMIT)
+        {
+            pop_heap(heap.begin(), heap.end(), cmp);
+            auto [d, u] = heap.back();
+            heap.pop_back();
+            if (d > witnessDist[u])
+                continue;
+            if (d > limit)
+                break;
+            settled++;
+
+            for (const Arc &a : adj[u])
+            {
+                if (contracted[a.to] || a.to == skip)
+                    continue;
+                int nd = d + a.weight;
+                if (nd < witnessDist[a.to])
+                {
+                    if (witnessDist[a.to] == INT_MAX)
+                        touched.push_back(a.to);
+                    witnessDist[a.to] = nd;
+                    heap.push_back({nd, a.to});
+                    push_heap(heap.begin(), heap.end(), cmp);
+                }
+            }
+        }
+    };
+
+    // Shortcuts contracting v would need, as {u, {x, weight, v}}
+    auto findShortcuts = [&](int v, vector<pair<int, Arc>> &shortcuts)
+    {
+        shortcuts.clear();
+        vector<Arc> nb;
+        for (const Arc &a : adj[v])
+            if (!contracted[a.to])
+                nb.push_back(a);
+
+        for (size_t i = 0; i < nb.size(); ++i)
+        {
+            int limit = 0;
+            for (size_t j = i + 1; j < nb.size(); ++j)
+                limit = max(limit, nb[i].weight + nb[j].weight);
+            if (i + 1 == nb.size())
+                break;
+
+            witnessSearch(nb[i].to, v, limit);
+            for (size_t j = i + 1; j < nb.size(); ++j)
+            {
+                int via = nb[i].weight + nb[j].weight;
+                if (witnessDist[nb[j].to] > via)
+                    shortcuts.push_back({nb[i].to, {nb[j].to, via, v}});
+            }
+        }
+        return (int)nb.size();
+    };
+
+    // Edge difference plus contracted neighbours keeps the hierarchy small and flat
+    vector<pair<int, Arc>> shortcuts;
+    auto priority = [&](int v)
+    {
+        int degree = findShortcuts(v, shortcuts);
+        return (int)shortcuts.size() - degree + deletedNeighbours[v];
+    };
+
+    auto addArc = [&](int u, const Arc &arc)
+    {
+        for (Arc &a : adj[u])
+        {
+            if (a.to == arc.to)
+            {
+                if (arc.weight < a.weight)
+                    a = arc;
+                return;
+            }
+        }
+        adj[u].push_back(arc);
+    };
+
+    vector<int> currentPriority(n);
+    vector<pair<int, int>> queue;
+    for (int v = 0; v < n; ++v)
+    {
+        currentPriority[v] = priority(v);
+        queue.push_back({currentPriority[v], v});
+    }
+    make_heap(queue.begin(), queue.end(), cmp);
+
+    int nextRank = 0;
+    while (!queue.empty())
+    {
+        pop_heap(queue.begin(), queue.end(), cmp);
+        auto [p, v] = queue.back();
+        queue.pop_back();
+        if (contracted[v] || p != currentPriority[v])
+            continue;
+
+        // Lazy update: re-queue if v is no longer the cheapest node to contract
+        int fresh = priority(v);
+        if (!queue.empty() && fresh > queue.front().first)
+        {
+            currentPriority[v] = fresh;
+            queue.push_back({fresh, v});
+            push_heap(queue.begin(), queue.end(), cmp);
+            continue;
+        }
+
+        findShortcuts(v, shortcuts);
+        for (const Arc &a : adj[v])
+            if (!contracted[a.to])
+                up[v].push_back(a);
+
+        for (const auto &s : shortcuts)
+        {
+            addArc(s.first, s.second);
+            addArc(s.second.to, {s.first, s.second.weight, s.second.middle});
+        }
+
+        contracted[v] = true;
+        ch.rank[v] = nextRank++;
+
+        for (const Arc &a : up[v])
+        {
+            deletedNeighbours[a.to]++;
+            currentPriority[a.to] = priority(a.to);
+            queue.push_back({currentPriority[a.to], a.to});
+            push_heap(queue.begin(), queue.end(), cmp);
+        }
+    }
+
+    ch.upOffsets.assign(n + 1, 0);
+    for (int v = 0; v < n; ++v)
+    {
+        ch.upOffsets[v + 1] = ch.upOffsets[v] + up[v].size();
+        for (const Arc &a : up[v])
+        {
+            ch.upTargets.push_back(a.to);
+            ch.upWeights.push_back(a.weight);
+            ch.upMiddle.push_back(a.middle);
+        }
+    }
+
+    engine->liveRouting.hierarchy = move(ch);
+    engine->liveRouting.version++;
+}
+
+// Appends the nodes after from up to and including to for the hierarchy edge
+// from-to, expanding shortcuts recursively into original edges
+void unpackHierarchyEdge(int from, int to, int middle, vector<int> &path)
+{
+    const ContractionHierarchy &hierarchy = routing->hierarchy;
+    if (middle == -1)
+    {
+        path.push_back(to);
+        return;
+    }
+
+    // Both halves of the shortcut are upward edges of the bypassed node
+    auto middleOf = [&](int other)
+    {
+        for (int e = hierarchy.upOffsets[middle]; e < hierarchy.upOffsets[middle + 1]; ++e)
+            if (hierarchy.upTargets[e] == other)
+                return hierarchy.upMiddle[e];
+        return -1;
+    };
+
+    unpackHierarchyEdge(from, middle, middleOf(from), path);
+    unpackHierarchyEdge(middle, to, middleOf(to), path);
+}
+
+// Bidirectional upward search over the hierarchy from any of the source nodes
+// to any of the target nodes. Returns the distance (INT_MAX if unreachable)
+// and, if path is given, the node path with all shortcuts unpacked.
+int hierarchyRoute(IdSpan sources, IdSpan targets, vector<int> *path)
+{
+    const ContractionHierarchy &hierarchy = routing->hierarchy;
+    int n = hierarchy.rank.size();
+
+    // One search direction; only the touched entries are reset after a query
+    struct Side
+    {
+        vector<int> dist;
+        vector<int> parent;
+        vector<int> parentMiddle;
+        vector<int> touched;
+        vector<pair<int, int>> heap;
+    };
+    thread_local Side sides[2];
+    greater<pair<int, int>> cmp;
+
+    for (int s = 0; s < 2; ++s)
+    {
+        Side &side = sides[s];
+        if (side.dist.size() != (size_t)n)
+        {
+            side.dist.assign(n, INT_MAX);
+            side.parent.assign(n, -1);
+            side.parentMiddle.assign(n, -1);
+            side.touched.clear();
+        }
+        side.heap.clear();
+        for (int node : s == 0 ? sources : targets)
+        {
+            if (side.dist[node] == 0)
+                continue;
+            side.dist[node] = 0;
+            side.parent[node] = -1;
+            side.touched.push_back(node);
+            COUNT_WORK(heapPushes, 1);
+            side.heap.push_back({0, node});
+        }
+        make_heap(side.heap.begin(), side.heap.end(), cmp);
+    }
+
+    int best = INT_MAX;
+    int meet = -1;
+
+    while (true)
+    {
+        // Continue on the side with the smaller key; a side is done once its
+        // smallest key cannot improve the best meeting distance
+        int s = -1;
+        for (int i = 0; i < 2; ++i)
+        {
+            const Side &side = sides[i];
+            if (!side.heap.empty() && side.heap.front().first < best &&
+                (s == -1 || side.heap.front().first < sides[s].heap.front().first))
+                s = i;
+        }
+        if (s == -1)
+            break;
+
+        Side &side = sides[s];
+        Side &other = sides[s ^ 1];
+        pop_heap(side.heap.begin(), side.heap.end(), cmp);
+        auto [d, u] = side.heap.back();
+        side.heap.pop_back();
+        if (d > side.dist[u])
+            continue;
+        settledNodes++;
+        COUNT_WORK(edgesRelaxed, hierarchy.upOffsets[u + 1] - hierarchy.upOffsets[u]);
+
+        if (other.dist[u] != INT_MAX && d + other.dist[u] < best)
+        {
+            best = d + other.dist[u];
+            meet = u;
+        }
+
+        for (int e = hierarchy.upOffsets[u]; e < hierarchy.upOffsets[u + 1]; ++e)
+        {
+            int v = hierarchy.upTargets[e];
+            int nd = d + hierarchy.upWeights[e];
+            if (nd < side.dist[v])
+            {
+                if (side.dist[v] == INT_MAX)
+                    side.touched.push_back(v);
+                side.dist[v] = nd;
+                side.parent[v] = u;
+                side.parentMiddle[v] = hierarchy.upMiddle[e];
+                COUNT_WORK(heapPushes, 1);
+                side.heap.push_back({nd, v});
+                push_heap(side.heap.begin(), side.heap.end(), cmp);
+            }
+        }
+    }
+
+    if (path)
+    {
+        path->clear();
+        if (meet != -1)
+        {
+            // Source side: walk back from the meeting node, then unpack forwards
+            vector<int> chain;
+            for (int at = meet; at != -1; at = sides[0].parent[at])
+                chain.push_back(at);
+            reverse(chain.begin(), chain.end());
+            path->push_back(chain[0]);
+            for (size_t i = 1; i < chain.size(); ++i)
+                unpackHierarchyEdge(chain[i - 1], chain[i], sides[0].parentMiddle[chain[i]], *path);
+
+            // Target side: parents already lead from the meeting node to a target
+            for (int at = meet; sides[1].parent[at] != -1; at = sides[1].parent[at])
+                unpackHierarchyEdge(at, sides[1].parent[at], sides[1].parentMiddle[at], *path);
+        }
+    }
+
+    for (Side &side : sides)
+    {
+        for (int t : side.touched)
+        {
+            side.dist[t] = INT_MAX;
+            side.parent[t] = -1;
+        }
+        side.touched.clear();
+    }
+
+    return best;
+}
+
+// Point-to-point search from both ends at once over the full graph. The
+// side with the smaller key is advanced; the search stops once the two
+// smallest keys together cannot beat the best meeting distance.
+// Returns INT_MAX if no target is reachable.
+int bidirectionalRoute(IdSpan sources, IdSpan targets, vector<int> *path)
+{
+    const CsrGraph &graph = routing->graph;
+    int n = graph.size();
+
+    // One search direction; only the touched entries are reset after a query
+    struct Side
+    {
+        vector<int> dist;
+        vector<int> parent;
+        vector<int> touched;
+        vector<pair<int, int>> heap;
+    };
+    thread_local Side sides[2];
+    greater<pair<int, int>> cmp;
+
+    for (int s = 0; s < 2; ++s)
+    {
+        Side &side = sides[s];
+        if (side.dist.size() != (size_t)n)
+        {
+            side.dist.assign(n, INT_MAX);
+            side.parent.assign(n, -1);
+            side.touched.clear();
+        }
+        side.heap.clear();
+        for (int node : s == 0 ? sources : targets)
+        {
+            if (side.dist[node] == 0)
+                continue;
+            side.dist[node] = 0;
+            side.parent[node] = -1;
+            side.touched.push_back(node);
+            COUNT_WORK(heapPushes, 1);
+            side.heap.push_back({0, node});
+        }
+        make_heap(side.heap.begin(), side.heap.end(), cmp);
+    }
+
+    int best = INT_MAX;
+    int meet = -1;
+
+    while (!sides[0].heap.empty() && !sides[1].heap.empty())
+    {
+        long long keys = (long long)sides[0].heap.front().first + sides[1].heap.front().first;
+        if (keys >= best)
+            break;
+
+        int s = sides[0].heap.front().first <= sides[1].heap.front().first ? 0 : 1;
+        Side &side = sides[s];
+        Side &other = sides[s ^ 1];
+        pop_heap(side.heap.begin(), side.heap.end(), cmp);
+        auto [d, u] = side.heap.back();
+        side.heap.pop_back();
+        if (d > side.dist[u])
+            continue;
+        settledNodes++;
+        COUNT_WORK(edgesRelaxed, graph.offsets[u + 1] - graph.offsets[u]);
+
+        for (int e = graph.offsets[u]; e < graph.offsets[u + 1]; ++e)
+        {
+            if (graph.weights[e] == CLOSED_EDGE)
+                continue;
+            int v = graph.targets[e];
+            int nd = d + graph.weights[e];
+            if (nd < side.dist[v])
+            {
+                if (side.dist[v] == INT_MAX)
+                    side.touched.push_back(v);
+                side.dist[v] = nd;
+                side.parent[v] = u;
+                COUNT_WORK(heapPushes, 1);
+                side.heap.push_back({nd, v});
+                push_heap(side.heap.begin(), side.heap.end(), cmp);
+            }
+            // Every edge scanned may close a shorter connection through v
+            if (other.dist[v] != INT_MAX && side.dist[v] + other.dist[v] < best)
+            {
+                best = side.dist[v] + other.dist[v];
+                meet = v;
+            }
+        }
+        if (other.dist[u] != INT_MAX && d + other.dist[u] < best)
+        {
+            best = d + other.dist[u];
+            meet = u;
+        }
+    }
+
+    if (path)
+    {
+        path->clear();
+        if (meet != -1)
+        {
+            for (int at = meet; at != -1; at = sides[0].parent[at])
+                path->push_back(at);
+            reverse(path->begin(), path->end());
+            for (int at = sides[1].parent[meet]; at != -1; at = sides[1].parent[at])
+                path->push_back(at);
+        }
+    }
+
+    for (Side &side : sides)
+    {
+        for (int t : side.touched)
+        {
+            side.dist[t] = INT_MAX;
+            side.parent[t] = -1;
+        }
+        side.touched.clear();
+    }
+
+    return best;
+}
+
+// Picks up to count landmarks among the line terminals, each one as far as
+// possible from those already picked, and stores a full Dijkstra from each.
+void buildLandmarks(int count)
+{
+    int n = engine->liveRouting.graph.size();
+    LandmarkTable table;
+
+    // Terminals: first and last node of every line
+    vector<int> candidates;
+    for (int u = 0; u < n; ++u)
+    {
+        bool first = u == 0 || engine->stations.nodeLine[u - 1] != engine->stations.nodeLine[u];
+        bool last = u == n - 1 || engine->stations.nodeLine[u + 1] != engine->stations.nodeLine[u];
+        if (first || last)
+            candidates.push_back(u);
+    }
+
+    // closest[v]: distance from v to the nearest landmark so far
+    vector<long long> closest(n, LLONG_MAX);
+    vector<vector<int>> columns, parentColumns;
+    vector<int> dist, prev;
+    while ((int)table.landmarks.size() < count && !candidates.empty())
+    {
+        // Unreachable candidates count as infinitely far, so every component gets one
+        auto far = max_element(candidates.begin(), candidates.end(), [&](int a, int b)
+                               { return closest[a] < closest[b]; });
+        if (closest[*far] == 0)
+            break;
+        int landmark = *far;
+        candidates.erase(far);
+
+        dijkstra(landmark, dist, prev);
+        for (int v = 0; v < n; ++v)
+            closest[v] = min<long long>(closest[v], dist[v] == INT_MAX ? LLONG_MAX : dist[v]);
+        table.landmarks.push_back(landmark);
+        columns.push_back(dist);
+        parentColumns.push_back(prev);
+    }
+
+    int k = table.landmarks.size();
+    table.dist.resize((size_t)n * k);
+    table.parent.resize((size_t)n * k);
+    for (int v = 0; v < n; ++v)
+        for (int i = 0; i < k; ++i)
+        {
+            table.dist[(size_t)v * k + i] = columns[i][v];
+            table.parent[(size_t)v * k + i] = parentColumns[i][v];
+        }
+
+    engine->liveRouting.landmarkTable = move(table);
+    engine->liveRouting.version++;
+}
+
+// A* towards the nearest of the targets, with the ALT bound of the closest
+// target as potential. The bound is consistent, so the first target taken
+// off the heap is optimal, as in dijkstraToAny. Returns INT_MAX if no
+// target is reachable.
+int altRoute(IdSpan sources, IdSpan targets, vector<int> *path)
+{
+    const CsrGraph &graph = routing->graph;
+    const LandmarkTable &landmarkTable = routing->landmarkTable;
+    int n = graph.size();
+    int k = landmarkTable.landmarks.size();
+    const int *table = landmarkTable.dist.data();
+
+    // Only the touched entries are reset after a query
+    thread_local vector<int> dist, parent, bound, touched;
+    thread_local vector<pair<int, int>> heap; // {distance + bound, node}
+    if (dist.size() != (size_t)n)
+    {
+        dist.assign(n, INT_MAX);
+        parent.assign(n, -1);
+        bound.assign(n, -1);
+        touched.clear();
+    }
+    greater<pair<int, int>> cmp;
+    heap.clear();
+
+    auto lowerBound = [&](int v)
+    {
+        if (bound[v] != -1)
+            return bound[v];
+        const int *row = table + (size_t)v * k;
+        int best = INT_MAX;
+        for (int t : targets)
+        {
+            const int *trow = table + (size_t)t * k;
+            int h = 0;
+            for (int i = 0; i < k; ++i)
+                if (row[i] != INT_MAX && trow[i] != INT_MAX)
+                    h = max(h, abs(trow[i] - row[i]));
+            best = min(best, h);
+        }
+        return bound[v] = best;
+    };
+    auto touch = [&](int v)
+    {
+        if (dist[v] == INT_MAX && bound[v] == -1)
+            touched.push_back(v);
+    };
+
+    for (int src : sources)
+    {
+        if (dist[src] == 0)
+            continue;
+        touch(src);
+        dist[src] = 0;
+        COUNT_WORK(heapPushes, 1);
+        heap.push_back({lowerBound(src), src});
+    }
+    make_heap(heap.begin(), heap.end(), cmp);
+
+    int reached = -1;
+    while (!heap.empty())
+    {
+        pop_heap(heap.begin(), heap.end(), cmp);
+        auto [key, u] = heap.back();
+        heap.pop_back();
+        if (key - bound[u] > dist[u])
+            continue;
+        settledNodes++;
+        COUNT_WORK(edgesRelaxed, graph.offsets[u + 1] - graph.offsets[u]);
+
+        if (find(targets.begin(), targets.end(), u) != targets.end())
+        {
+            reached = u;
+            break;
+        }
+
+        for (int e = graph.offsets[u]; e < graph.offsets[u + 1]; ++e)
+        {
+            if (graph.weights[e] == CLOSED_EDGE)
+                continue;
+            int v = graph.targets[e];
+            int nd = dist[u] + graph.weights[e];
+            if (nd < dist[v])
+            {
+                touch(v);
+                dist[v] = nd;
+                parent[v] = u;
+                COUNT_WORK(heapPushes, 1);
+                heap.push_back({nd + lowerBound(v), v});
+                push_heap(heap.begin(), heap.end(), cmp);
+            }
+        }
+    }
+
+    int result = reached == -1 ? INT_MAX : dist[reached];
+    if (path)
+    {
+        path->clear();
+        for (int at = reached; at != -1; at = parent[at])
+            path->push_back(at);
+        reverse(path->begin(), path->end());
+    }
+
+    for (int t : touched)
+    {
+        dist[t] = INT_MAX;
+        parent[t] = -1;
+        bound[t] = -1;
+    }
+    touched.clear();
+
+    return result;
+}
+
+// k x k matrix of shortest distances between the stations to visit.
+// Runs one Dijkstra per station, seeded with all of its node indexes.
+vector<vector<int>> stationDistanceMatrix(const vector<int> &locToVisit)
+{
+    int k = locToVisit.size();
+    vector<vector<int>> d(k, vector<int>(k, INT_MAX));
+    vector<int> dist, prev;
+
+    for (int i = 0; i < k; ++i)
+    {
+        dijkstraToAny(stationNodes(locToVisit[i]), IdSpan(), dist, prev);
+        for (int j = 0; j < k; ++j)
+        {
+            for (int destIndex : stationNodes(locToVisit[j]))
+            {
+                d[i][j] = min(d[i][j], dist[destIndex]);
+            }
+        }
+    }
+
+    return d;
+}
+
+// Held-Karp bitmask DP over the distance matrix, starting from stop 0.
+// dp[mask][j] is the shortest walk that starts at stop 0, visits exactly the
+// stops in mask (bit j stands for stop j + 1) and ends at stop j + 1.
+// With returnToStart the tour closes back at stop 0, otherwise it may end anywhere.
+TripPlan tsp(const vector<vector<int>> &d, bool returnToStart)
+{
+    TIME_OPERATION(Operation::Tsp);
+    int k = d.size();
+    TripPlan plan;
+    plan.total = INT_MAX;
+    if (k == 0)
+        return plan;
+    if (k == 1)
+    {
+        plan.order = {0};
+        plan.total = 0;
+        return plan;
+    }
+
+    int m = k - 1;
+    int full = (1 << m) - 1;
+    vector<int> dp((size_t)(full + 1) * m, INT_MAX);
+    vector<signed char> parent((size_t)(full + 1) * m, -1);
+
+    for (int j = 0; j < m; ++j)
+        dp[(size_t)(1 << j) * m + j] = d[0][j + 1];
+
+    for (int mask = 1; mask <= full; ++mask)
+    {
+        for (int j = 0; j < m; ++j)
+        {
+            int cur = dp[(size_t)mask * m + j];
+            if (!(mask & (1 << j)) || cur == INT_MAX)
+                continue;
+
+            for (int nxt = 0; nxt < m; ++nxt)
+            {
+                if ((mask & (1 << nxt)) || d[j + 1][nxt + 1] == INT_MAX)
+                    continue;
+
+                int nextMask = mask | (1 << nxt);
+                int cand = cur + d[j + 1][nxt + 1];
+                if (cand < dp[(size_t)nextMask * m + nxt])
+                {
+                    dp[(size_t)nextMask * m + nxt] = cand;
+                    parent[(size_t)nextMask * m + nxt] = j;
+                }
+            }
+        }
+    }
+
+    // Pick the best last stop, including the way back for a closed tour
+    int last = -1;
+    for (int j = 0; j < m; ++j)
+    {
+        int cur = dp[(size_t)full * m + j];
+        if (cur == INT_MAX)
+            continue;
+        if (returnToStart)
+        {
+            if (d[j + 1][0] == INT_MAX)
+                continue;
+            cur += d[j + 1][0];
+        }
+        if (cur < plan.total)
+        {
+            plan.total = cur;
+            last = j;
+        }
+    }
+
+    if (last == -1)
+        return plan;
+
+    // Walk the parent links back to stop 0
+    int mask = full;
+    while (last != -1)
+    {
+        plan.order.push_back(last + 1);
+        int p = parent[(size_t)mask * m + last];
+        mask ^= 1 << last;
+        last = p;
+    }
+    plan.order.push_back(0);
+    reverse(plan.order.begin(), plan.order.end());
+
+    return plan;
+}
+
+// Length of a visiting order, closing the loop back to the first stop if asked
+long long tripLength(const vector<vector<int>> &d, const vector<int> &order, bool returnToStart)
+{
+    long long total = 0;
+    for (size_t i = 0; i + 1 < order.size(); ++i)
+        total += d[order[i]][order[i + 1]];
+    if (returnToStart && order.size() > 1)
+        total += d[order.back()][order[0]];
+    return total;
+}
+
+// Lower bound on any trip over the matrix: a minimum spanning tree for an open
+// path, and a 1-tree (MST over stops 1..k-1 plus the two cheapest edges out of
+// stop 0) for a closed tour. Prim's algorithm, O(k^2).
+long long tripLowerBound(const vector<vector<int>> &d, bool returnToStart)
+{
+    int k = d.size();
+    int first = returnToStart ? 1 : 0;
+    if (k - first <= 1)
+        return 0;
+
+    vector<long long> best(k, LLONG_MAX);
+    vector<bool> inTree(k, false);
+    long long total = 0;
+    best[first] = 0;
+
+    for (int step = first; step < k; ++step)
+    {
+        int u = -1;
+        for (int v = first; v < k; ++v)
+            if (!inTree[v] && (u == -1 || best[v] < best[u]))
+                u = v;
+        inTree[u] = true;
+        total += best[u];
+        for (int v = first; v < k; ++v)
+            if (!inTree[v] && d[u][v] < best[v])
+                best[v] = d[u][v];
+    }
+
+    if (returnToStart)
+    {
+        vector<int> out(d[0].begin() + 1, d[0].end());
+        sort(out.begin(), out.end());
+        total += (long long)out[0] + (out.size() > 1 ? out[1] : out[0]);
+    }
+
+    return total;
+}
+
+// Nearest-neighbour construction from stop 0. On restarts the next stop is
+// drawn from the three nearest unvisited ones to diversify the start tours.
+vector<int> nearestNeighbourTrip(const vector<vector<int>> &d, bool randomised, mt19937 &rng)
+{
+    int k = d.size();
+    vector<int> order = {0};
+    vector<bool> used(k, false);
+    used[0] = true;
+
+    for (int step = 1; step < k; ++step)
+    {
+        int cur = order.back();
+        vector<pair<int, int>> cand;
+        for (int v = 0; v < k; ++v)
+            if (!used[v])
+                cand.push_back({d[cur][v], v});
+
+        int pick = 0;
+        if (randomised)
+        {
+            int pool = min<int>(3, cand.size());
+            partial_sort(cand.begin(), cand.begin() + pool, cand.end());
+            pick = rng() % pool;
+        }
+        else
+        {
+            pick = min_element(cand.begin(), cand.end()) - cand.begin();
+        }
+
+        order.push_back(cand[pick].second);
+        used[cand[pick].second] = true;
+    }
+
+    return order;
+}
+
+// 2-opt and Or-opt local search on a visiting order; stop 0 stays in front.
+// Returns false if the deadline was hit before reaching a local optimum.
+bool improveTrip(const vector<vector<int>> &d, vector<int> &order, bool returnToStart,
+                 chrono::steady_clock::time_point deadline)
+{
+    int k = order.size();
+    long long cur = tripLength(d, order, returnToStart);
+    bool improved = true;
+
+    while (improved)
+    {
+        if (chrono::steady_clock::now() >= deadline)
+            return false;
+        improved = false;
+
+        // 2-opt: reverse order[i..j]
+        for (int i = 1; i < k - 1 && !improved; ++i)
+        {
+            for (int j = i + 1; j < k; ++j)
+            {
+                int a = order[i - 1], b = order[i], c = order[j];
+                long long delta = (long long)d[a][c] - d[a][b];
+                if (j + 1 < k)
+                    delta += (long long)d[b][order[j + 1]] - d[c][order[j + 1]];
+                else if (returnToStart)
+                    delta += (long long)d[b][order[0]] - d[c][order[0]];
+
+                if (delta < 0)
+                {
+                    reverse(order.begin() + i, order.begin() + j + 1);
+                    cur += delta;
+                    improved = true;
+                    break;
+                }
+            }
+        }
+
+        // Or-opt: move a run of 1-3 stops to another place in the order.
+        // next(x) is the stop after position x, or -1 past the end of an open path.
+        auto next = [&](int x)
+        { return x + 1 < k ? order[x + 1] : (returnToStart ? order[0] : -1); };
+        auto cost = [&](int u, int v)
+        { return v == -1 ? 0LL : (long long)d[u][v]; };
+
+        for (int len = 1; len <= 3 && !improved; ++len)
+        {
+            for (int i = 1; i + len <= k && !improved; ++i)
+            {
+                int j = i + len - 1;
+                int p = order[i - 1], first = order[i], last = order[j], nx = next(j);
+                long long removeDelta = cost(p, nx) - cost(p, first) - cost(last, nx);
+
+                for (int q = 0; q < k; ++q)
+                {
+                    if (q >= i - 1 && q <= j)
+                        continue;
+                    int at = order[q], b = next(q);
+                    long long delta = removeDelta + cost(at, first) + cost(last, b) - cost(at, b);
+                    if (delta < 0)
+                    {
+                        if (q < i)
+                            rotate(order.begin() + q + 1, order.begin() + i, order.begin() + j + 1);
+                        else
+                            rotate(order.begin() + i, order.begin() + j + 1, order.begin() + q + 1);
+                        cur += delta;
+                        improved = true;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+// Heuristic trip optimiser for stop counts beyond the exact DP.
+// Restarts nearest-neighbour construction + local search until maxRestarts
+// or the wall-clock budget runs out and keeps the best order. All randomness
+// comes from the seed, so a run that finishes its restarts within the budget
+// always returns the same plan for the same seed; one that does not is
+// flagged timedOut, as its plan depends on how fast the machine is.
+// budgetMs <= 0 sets no budget, which bounds the work by maxRestarts alone.
+HeuristicTripResult heuristicTsp(const vector<vector<int>> &d, bool returnToStart,
+                                 int budgetMs, unsigned seed, int maxRestarts = 64)
+{
+    TIME_OPERATION(Operation::HeuristicTsp);
+    auto deadline = budgetMs > 0 ? chrono::steady_clock::now() + chrono::milliseconds(budgetMs)
+                                 : chrono::steady_clock::time_point::max();
+    mt19937 rng(seed);
+
+    HeuristicTripResult result;
+    result.plan.total = INT_MAX;
+    result.lowerBound = tripLowerBound(d, returnToStart);
+    result.restarts = 0;
+    result.timedOut = false;
+    long long bestLength = LLONG_MAX;
+
+    result.gapPercent = 0;
+    if (d.empty() || find(d[0].begin(), d[0].end(), INT_MAX) != d[0].end())
+        return result;
+
+    for (int r = 0; r < maxRestarts; ++r)
+    {
+        vector<int> order = nearestNeighbourTrip(d, r > 0, rng);
+        bool finished = improveTrip(d, order, returnToStart, deadline);
+
+        long long length = tripLength(d, order, returnToStart);
+        if (length < bestLength)
+        {
+            bestLength = length;
+            result.plan.order = order;
+        }
+        result.restarts++;
+
+        if (!finished || (r + 1 < maxRestarts && chrono::steady_clock::now() >= deadline))
+        {
+            result.timedOut = true;
+            break;
+        }
+    }
+
+    // Like tsp(), no order when some stop cannot be reached
+    if (bestLength >= INT_MAX)
+    {
+        result.plan.order.clear();
+        return result;
+    }
+    result.plan.total = (int)bestLength;
+    result.gapPercent = result.lowerBound > 0 ? 100.0 * (bestLength - result.lowerBound) / result.lowerBound : 0;
+    return result;
+}
+
+// Helper to reconstruct path as node ids, source first
+vector<int> getPath(int dest, const vector<int> &prev)
+{
+    vector<int> path;
+    for (int at = dest; at != -1; at = prev[at]) {
+        path.push_back(at);
+    }
+        
+    reverse(path.begin(), path.end());
+    return path;
+}
+
+// Runs fn(i) for every i in [0, count) on up to the given number of threads,
+// all working on the engine and routing state of the calling thread
+void parallelFor(size_t count, int threads, const function<void(size_t)> &fn)
+{
+    threads = max(1, min<int>(threads, count));
+    atomic<size_t> next{0};
+    auto work = [&]
+    {
+        for (size_t i = next++; i < count; i = next++)
+            fn(i);
+    };
+
+    EngineState *callerEngine = engine;
+    const RoutingState *callerRouting = routing;
+    vector<thread> helpers;
+    for (int t = 1; t < threads; ++t)
+        helpers.emplace_back([&]
+                             {
+            engine = callerEngine;
+            routing = callerRouting;
+            work(); });
+    work();
+    for (thread &t : helpers)
+        t.join();
+}
+
+// Best meeting stations for a group, best first. Every distinct starting
+// station gets one Dijkstra (seeded with all its node indexes), run in
+// parallel. Candidates are then scored station by station and dropped as
+// soon as their partial longest journey (or total) is already worse than
+// the current N-th best.
+vector<MeetingPoint> findMeetingPoints(const vector<int> &friendStations, MeetingObjective objective, size_t topN, int threads = 1)
+{
+    TIME_OPERATION(Operation::MeetingPoints);
+    vector<MeetingPoint> result;
+    if (friendStations.empty() || topN == 0)
+        return result;
+
+    // Friends starting at the same station share one search
+    vector<int> starts = friendStations;
+    sort(starts.begin(), starts.end());
+    starts.erase(unique(starts.begin(), starts.end()), starts.end());
+    int S = starts.size();
+    int F = friendStations.size();
+
+    vector<int> startOf(F);
+    for (int f = 0; f < F; ++f)
+        startOf[f] = lower_bound(starts.begin(), starts.end(), friendStations[f]) - starts.begin();
+
+    vector<vector<int>> dist(S), prev(S);
+    parallelFor(S, threads, [&](size_t i)
+                { dijkstraToAny(stationNodes(starts[i]), IdSpan(), dist[i], prev[i]); });
+
+    // Every station is a candidate; station ids already follow the order of
+    // their first node. Station-level distance from every start to every
+    // candidate, candidate-major so scoring one candidate reads one contiguous row
+    int C = engine->stations.stationCount();
+    vector<int> table((size_t)C * S, INT_MAX);
+    for (int c = 0; c < C; ++c)
+        for (int s = 0; s < S; ++s)
+            for (int node : stationNodes(c))
+                table[(size_t)c * S + s] = min(table[(size_t)c * S + s], dist[s][node]);
+
+    // Current top N as {primary, secondary, candidate}, best first
+    struct Scored
+    {
+        long long primary;
+        long long secondary;
+        int candidate;
+    };
+    auto better = [](const Scored &a, const Scored &b)
+    { return a.primary != b.primary ? a.primary < b.primary : a.secondary < b.secondary; };
+    vector<Scored> best;
+
+    for (int c = 0; c < C; ++c)
+    {
+        const int *row = &table[(size_t)c * S];
+        bool full = best.size() == topN;
+        long long bound = full ? best.back().primary : LLONG_MAX;
+        int maxDistance = 0;
+        long long total = 0;
+        bool pruned = false;
+
+        for (int f = 0; f < F; ++f)
+        {
+            int d = row[startOf[f]];
+            if (d == INT_MAX)
+            {
+                pruned = true; // someone cannot reach this station
+                break;
+            }
+            maxDistance = max(maxDistance, d);
+            total += d;
+            if ((objective == MeetingObjective::MinMax ? maxDistance : total) > bound)
+            {
+                pruned = true;
+                break;
+            }
+        }
+        if (pruned)
+            continue;
+
+        Scored scored = objective == MeetingObjective::MinMax
+                            ? Scored{maxDistance, total, c}
+                            : Scored{total, maxDistance, c};
+        if (full && !better(scored, best.back()))
+            continue;
+        best.insert(upper_bound(best.begin(), best.end(), scored, better), scored);
+        if (best.size() > topN)
+            best.pop_back();
+    }
+
+    for (const Scored &scored : best)
+    {
+        IdSpan nodesOfStation = stationNodes(scored.candidate);
+        MeetingPoint point;
+        point.station = scored.candidate;
+        point.maxDistance = objective == MeetingObjective::MinMax ? scored.primary : scored.secondary;
+        point.totalDistance = objective == MeetingObjective::MinMax ? scored.secondary : scored.primary;
+
+        // Each friend arrives at whichever line of the station is nearest
+        for (int f = 0; f < F; ++f)
+        {
+            const vector<int> &d = dist[startOf[f]];
+            int arrival = *min_element(nodesOfStation.begin(), nodesOfStation.end(), [&](int a, int b)
+                                       { return d[a] < d[b]; });
+            point.paths.push_back(getPath(arrival, prev[startOf[f]]));
+        }
+        result.push_back(point);
+    }
+
+    return result;
+}
+
+void addInterchange(const string &name, int transferWeight = 2)
+{
+    int station = findStation(name);
+    if (station == -1)
+        return;
+    if (!engine->stations.nodesIndexed())
+        engine->stations.indexNodes();
+
+    IdSpan ids = stationNodes(station);
+    for (size_t i = 0; i < ids.size(); ++i)
+    {
+        for (size_t j = i + 1; j < ids.size(); ++j)
+        {
+            // Add small weight for transfers
+            connect(ids[i], ids[j], transferWeight); 
+        }
+    }
+}
+
+vector<string> splitFields(const string &line, char sep)
+{
+    vector<string> fields;
+    size_t start = 0;
+    while (true)
+    {
+        size_t end = line.find(sep, start);
+        fields.push_back(line.substr(start, end == string::npos ? string::npos : end - start));
+        if (end == string::npos)
+            break;
+        start = end + 1;
+    }
+    return fields;
+}
+
+// Strict decimal integer: the whole text has to be a number that fits an int
+bool parseInteger(const string &text, int &value)
+{
+    if (text.empty())
+        return false;
+    char *end = nullptr;
+    errno = 0;
+    long parsed = strtol(text.c_str(), &end, 10);
+    if (*end != '\0' || errno == ERANGE || parsed < INT_MIN || parsed > INT_MAX)
+        return false;
+    value = (int)parsed;
+    return true;
+}
+
+// Adds a line with its stations in order. segmentKm[i] is the distance
+// between station i and i + 1; missing entries default to 1 KM.
+void addLine(const vector<string> &line, char prefix, const vector<int> &segmentKm = {})
+{
+    int offset = nodeCount();
+    addNodes(line, prefix);
+
+    for (int i = 0; i + 1 < (int)line.size(); ++i)
+    {
+        connect(offset + i, offset + i + 1, i < (int)segmentKm.size() ? segmentKm[i] : 1);
+    }
+}
+
+// Reads a network description, one record per line:
+//   LINE|<prefix>|<line name>         starts a new line, prefix is one character
+//   STATION|<name>[|<km>]             next station of the current line, km from the previous one (default 1)
+//   INTERCHANGE|<name>[|<weight>]     links all lines through this station (default weight 2)
+// Empty lines and lines starting with '#' are ignored.
+// Call initializeGraph() before and buildGraph() after.
+bool loadNetworkFile(const string &fileName)
+{
+    ifstream in(fileName);
+    if (!in)
+    {
+        cerr << "Cannot open " << fileName << "\n";
+        return false;
+    }
+
+    struct LineRecord
+    {
+        char prefix;
+        vector<string> stations;
+        vector<int> segmentKm;
+    };
+    vector<LineRecord> lines;
+    vector<pair<string, int>> interchanges;
+
+    string text;
+    int lineNumber = 0;
+    auto fail = [&](const string &message)
+    {
+        cerr << fileName << ":" << lineNumber << ": " << message << "\n";
+        return false;
+    };
+
+    while (getline(in, text))
+    {
+        lineNumber++;
+        if (!text.empty() && text.back() == '\r')
+            text.pop_back();
+        if (text.empty() || text[0] == '#')
+            continue;
+
+        vector<string> fields = splitFields(text, '|');
+        int number = 0;
+        if (fields.size() == 3 && fields[0] != "LINE")
+        {
+            if (!parseInteger(fields[2], number) || number <= 0)
+                return fail("expected a positive number, got '" + fields[2] + "'");
+        }
+
+        if (fields[0] == "LINE" && fields.size() == 3)
+        {
+            if (fields[1].size() != 1)
+                return fail("line prefix must be a single character");
+            for (const LineRecord &l : lines)
+                if (l.prefix == fields[1][0])
+                    return fail("duplicate line prefix '" + fields[1] + "'");
+            lines.push_back({fields[1][0], {}, {}});
+        }
+        else if (fields[0] == "STATION" && (fields.size() == 2 || fields.size() == 3))
+        {
+            if (lines.empty())
+                return fail("STATION before the first LINE");
+            LineRecord &line = lines.back();
+            if (!line.stations.empty())
+                line.segmentKm.push_back(fields.size() == 3 ? number : 1);
+            line.stations.push_back(fields[1]);
+        }
+        else if (fields[0] == "INTERCHANGE" && (fields.size() == 2 || fields.size() == 3))
+        {
+            interchanges.push_back({fields[1], fields.size() == 3 ? number : 2});
+        }
+        else
+        {
+            return fail("unrecognised record '" + text + "'");
+        }
+    }
+
+    for (const LineRecord &line : lines)
+        addLine(line.stations, line.prefix, line.segmentKm);
+
+    for (const auto &interchange : interchanges)
+    {
+        if (findStation(interchange.first) == -1)
+        {
+            cerr << fileName << ": interchange '" << interchange.first << "' is not on any line\n";
+            return false;
+        }
+        addInterchange(interchange.first, interchange.second);
+    }
+
+    return true;
+}
+
+// Line prefixes used for generated networks
+const string SYNTHETIC_LINE_PREFIXES = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+
+// Replaces the current network with a random one of the given shape.
+// Segments are 1-3 KM; interchanges rename a station on one line to a
+// station of another line and link them with addInterchange().
+// Call buildGraph() afterwards.
+bool loadSyntheticNetwork(const SyntheticNetworkSpec &spec)
+{
+    if (spec.lines < 1 || spec.stationsPerLine < 2 || spec.lines + spec.branches > (int)SYNTHETIC_LINE_PREFIXES.size())
+    {
+        cerr << "Synthetic networks need 1 to " << SYNTHETIC_LINE_PREFIXES.size()
+             << " lines (branches included) with at least 2 stations each\n";
+        return false;
+    }
+
+    mt19937 rng(spec.seed);
+    clearNetwork();
+
+    vector<vector<string>> lines(spec.lines);
+    for (int l = 0; l < spec.lines; ++l)
+        for (int i = 0; i < spec.stationsPerLine; ++i)
+            lines[l].push_back("Line " + to_string(l + 1) + " Stop " + to_string(i + 1));
+
+    vector<string> interchanges;
+    for (int k = 0; k < spec.interchanges && spec.lines > 1; ++k)
+    {
+        int a = rng() % spec.lines;
+        int b = rng() % spec.lines;
+        if (a == b)
+            b = (b + 1) % spec.lines;
+        int i = rng() % spec.stationsPerLine;
+        int j = rng() % spec.stationsPerLine;
+
+        // Skip stops that are already interchanges to keep one name per line
+        if (lines[a][i].rfind("Line ", 0) != 0 || lines[b][j].rfind("Line ", 0) != 0)
+            continue;
+        string name = "Interchange " + to_string(interchanges.size() + 1);
+        lines[a][i] = name;
+        lines[b][j] = name;
+        interchanges.push_back(name);
+    }
+
+    // A branch starts at a station of an existing line and becomes an interchange there
+    int branchLength = max(2, spec.stationsPerLine / 4);
+    for (int k = 0; k < spec.branches; ++k)
+    {
+        int parent = rng() % spec.lines;
+        int at = rng() % spec.stationsPerLine;
+        vector<string> branch = {lines[parent][at]};
+        for (int i = 1; i < branchLength; ++i)
+            branch.push_back("Branch " + to_string(k + 1) + " Stop " + to_string(i));
+        interchanges.push_back(branch[0]);
+        lines.push_back(branch);
+    }
+
+    sort(interchanges.begin(), interchanges.end());
+    interchanges.erase(unique(interchanges.begin(), interchanges.end()), interchanges.end());
+
+    for (size_t l = 0; l < lines.size(); ++l)
+    {
+        vector<int> segmentKm;
+        for (size_t i = 0; i + 1 < lines[l].size(); ++i)
+            segmentKm.push_back(1 + rng() % 3);
+        addLine(lines[l], SYNTHETIC_LINE_PREFIXES[l], segmentKm);
+    }
+
+    for (const string &name : interchanges)
+        addInterchange(name);
+
+    return true;
+}
+
+// Binary snapshot of the built network: the CSR graph, the station name
+// tables, the search index and, if built, the contraction hierarchy, so a
+// start-up only has to map the file and copy flat arrays instead of parsing
+// and sorting everything again.
+// All sections are 4-byte aligned and follow the header in this order:
+//   int32  offsets[nodeCount + 1], targets[edgeCount], weights[edgeCount]
+//   int32  nodeStation[nodeCount]
+//   char   nodeLine[nodeCount]
+//   uint32 nameOffsets[stationCount + 1]   into the name bytes
+//   char   names[nameBytes]
+//   int32  hashSlots[hashSlotCount], stationNodeOffsets[stationCount + 1],
+//          stationNodeList[nodeCount]
+//   char   searchText[searchTextBytes]
+//   int32  nameStart[stationCount], byName[stationCount],
+//          suffixes[suffixCount], posToName[searchTextBytes]
+//   and with SNAPSHOT_HAS_HIERARCHY:
+//   int32  rank[nodeCount], upOffsets[nodeCount + 1], upTargets[hierarchyEdgeCount],
+//          upWeights[hierarchyEdgeCount], upMiddle[hierarchyEdgeCount]
+const char SNAPSHOT_MAGIC[8] = {'M', 'E', 'T', 'R', 'O', 'G', 'O', '\0'};
+const uint32_t SNAPSHOT_VERSION = 3;
+const uint32_t SNAPSHOT_HAS_HIERARCHY = 1;
+
+struct SnapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t nodeCount;
+    uint32_t edgeCount;
+    uint32_t stationCount;
+    uint32_t nameBytes;
+    uint32_t hashSlotCount;
+    uint32_t searchTextBytes;
+    uint32_t suffixCount;
+    uint32_t flags;
+    uint32_t hierarchyEdgeCount;
+};
+
+template <typename T>
+void appendSection(string &out, const T *data, size_t count)
+{
+    out.append(reinterpret_cast<const char *>(data), count * sizeof(T));
+    out.append((4 - out.size() % 4) % 4, '\0');
+}
+
+bool writeSnapshot(const string &fileName)
+{
+    const StationSearchIndex &index = engine->searchIndex;
+    const CsrGraph &graph = engine->liveRouting.graph;
+    const ContractionHierarchy &hierarchy = engine->liveRouting.hierarchy;
+
+    SnapshotHeader header;
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.nodeCount = engine->stations.nodeCount();
+    header.edgeCount = graph.targets.size();
+    header.stationCount = engine->stations.stationCount();
+    header.nameBytes = engine->stations.nameArena.size();
+    header.hashSlotCount = engine->stations.hashSlots.size();
+    header.searchTextBytes = index.text.size();
+    header.suffixCount = index.suffixes.size();
+    header.flags = hierarchy.empty() ? 0 : SNAPSHOT_HAS_HIERARCHY;
+    header.hierarchyEdgeCount = hierarchy.upTargets.size();
+
+    string out;
+    appendSection(out, &header, 1);
+    appendSection(out, graph.offsets.data(), graph.offsets.size());
+    appendSection(out, graph.targets.data(), graph.targets.size());
+    appendSection(out, graph.weights.data(), graph.weights.size());
+    appendSection(out, engine->stations.nodeStation.data(), engine->stations.nodeStation.size());
+    appendSection(out, engine->stations.nodeLine.data(), engine->stations.nodeLine.size());
+    appendSection(out, engine->stations.nameOffsets.data(), engine->stations.nameOffsets.size());
+    appendSection(out, engine->stations.nameArena.data(), engine->stations.nameArena.size());
+    appendSection(out, engine->stations.hashSlots.data(), engine->stations.hashSlots.size());
+    appendSection(out, engine->stations.stationNodeOffsets.data(), engine->stations.stationNodeOffsets.size());
+    appendSection(out, engine->stations.stationNodeList.data(), engine->stations.stationNodeList.size());
+    appendSection(out, index.text.data(), index.text.size());
+    appendSection(out, index.nameStart.data(), index.nameStart.size());
+    appendSection(out, index.byName.data(), index.byName.size());
+    appendSection(out, index.suffixes.data(), index.suffixes.size());
+    appendSection(out, index.posToName.data(), index.posToName.size());
+    if (!hierarchy.empty())
+    {
+        appendSection(out, hierarchy.rank.data(), hierarchy.rank.size());
+        appendSection(out, hierarchy.upOffsets.data(), hierarchy.upOffsets.size());
+        appendSection(out, hierarchy.upTargets.data(), hierarchy.upTargets.size());
+        appendSection(out, hierarchy.upWeights.data(), hierarchy.upWeights.size());
+        appendSection(out, hierarchy.upMiddle.data(), hierarchy.upMiddle.size());
+    }
+
+    FILE *f = fopen(fileName.c_str(), "wb");
+    if (!f)
+    {
+        cerr << "Cannot write " << fileName << "\n";
+        return false;
+    }
+    bool ok = fwrite(out.data(), 1, out.size(), f) == out.size();
+    ok = fclose(f) == 0 && ok;
+    if (!ok)
+        cerr << "Cannot write " << fileName << "\n";
+    return ok;
+}
+
+// Read-only view of a whole file, memory mapped where available
+class MappedFile
+{
+public:
+    explicit MappedFile(const string &fileName)
+    {
+#ifndef _WIN32
+        int fd = open(fileName.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED)
+            {
+                bytes = static_cast<const char *>(p);
+                length = st.st_size;
+            }
+        }
+        ::close(fd);
+#else
+        ifstream in(fileName, ios::binary);
+        fallback.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+        bytes = fallback.data();
+        length = fallback.size();
+#endif
+    }
+
+    ~MappedFile()
+    {
+#ifndef _WIN32
+        if (bytes)
+            munmap(const_cast<char *>(bytes), length);
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    const char *bytes = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    string fallback;
+#endif
+};
+
+// Walks the sections of a mapped snapshot, checking every read against the file size
+class SnapshotReader
+{
+public:
+    SnapshotReader(const char *data, size_t size) : data(data), size(size) {}
+
+    template <typename T>
+    const T *take(size_t count)
+    {
+        size_t bytes = count * sizeof(T);
+        if (!data || pos + bytes > size)
+        {
+            ok = false;
+            return nullptr;
+        }
+        const T *p = reinterpret_cast<const T *>(data + pos);
+        pos += bytes + (4 - bytes % 4) % 4;
+        return p;
+    }
+
+    template <typename T>
+    void takeInto(vector<T> &out, size_t count)
+    {
+        const T *p = take<T>(count);
+        if (p)
+            out.assign(p, p + count);
+    }
+
+    bool ok = true;
+
+private:
+    const char *data;
+    size_t size;
+    size_t pos = 0;
+};
+
+// CSR offsets of a snapshot: start at 0, never decrease and end at count
+template <typename T>
+bool validOffsets(const vector<T> &offsets, size_t count)
+{
+    if (offsets.empty() || offsets[0] != 0 || (size_t)offsets.back() != count)
+        return false;
+    for (size_t i = 1; i < offsets.size(); ++i)
+        if (offsets[i] < offsets[i - 1])
+            return false;
+    return true;
+}
+
+// Every id in [lowest, limit)
+bool validIds(const vector<int> &ids, int limit, int lowest = 0)
+{
+    for (int id : ids)
+        if (id < lowest || id >= limit)
+            return false;
+    return true;
+}
+
+// Replaces the current network with a snapshot written by writeSnapshot().
+// Every table, including the name hash, is copied straight out of the mapping.
+bool loadSnapshot(const string &fileName)
+{
+    MappedFile file(fileName);
+    SnapshotReader reader(file.data(), file.size());
+
+    const SnapshotHeader *header = reader.take<SnapshotHeader>(1);
+    if (!header || memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 || header->version != SNAPSHOT_VERSION)
+    {
+        cerr << fileName << " is not a MetroGo snapshot\n";
+        return false;
+    }
+
+    CsrGraph g;
+    StationTable table;
+    StationSearchIndex index;
+    reader.takeInto(g.offsets, header->nodeCount + 1);
+    reader.takeInto(g.targets, header->edgeCount);
+    reader.takeInto(g.weights, header->edgeCount);
+    reader.takeInto(table.nodeStation, header->nodeCount);
+    reader.takeInto(table.nodeLine, header->nodeCount);
+    reader.takeInto(table.nameOffsets, header->stationCount + 1);
+    const char *names = reader.take<char>(header->nameBytes);
+    reader.takeInto(table.hashSlots, header->hashSlotCount);
+    reader.takeInto(table.stationNodeOffsets, header->stationCount + 1);
+    reader.takeInto(table.stationNodeList, header->nodeCount);
+    const char *searchText = reader.take<char>(header->searchTextBytes);
+    reader.takeInto(index.nameStart, header->stationCount);
+    reader.takeInto(index.byName, header->stationCount);
+    reader.takeInto(index.suffixes, header->suffixCount);
+    reader.takeInto(index.posToName, header->searchTextBytes);
+
+    ContractionHierarchy ch;
+    if (header->flags & SNAPSHOT_HAS_HIERARCHY)
+    {
+        reader.takeInto(ch.rank, header->nodeCount);
+        reader.takeInto(ch.upOffsets, header->nodeCount + 1);
+        reader.takeInto(ch.upTargets, header->hierarchyEdgeCount);
+        reader.takeInto(ch.upWeights, header->hierarchyEdgeCount);
+        reader.takeInto(ch.upMiddle, header->hierarchyEdgeCount);
+    }
+
+    if (!reader.ok)
+    {
+        cerr << fileName << " is truncated\n";
+        return false;
+    }
+    table.nameArena.assign(names, header->nameBytes);
+    index.text.assign(searchText, header->searchTextBytes);
+
+    // Every index array is checked once, so a damaged file cannot index
+    // out of range later
+    int nodes = header->nodeCount;
+    int stationCount = header->stationCount;
+    int textBytes = header->searchTextBytes;
+    size_t slots = table.hashSlots.size();
+    bool valid = nodes >= 0 && stationCount >= 0 && textBytes >= 0 &&
+                 validOffsets(g.offsets, header->edgeCount) && validIds(g.targets, nodes) &&
+                 validIds(table.nodeStation, stationCount) &&
+                 validOffsets(table.nameOffsets, header->nameBytes) &&
+                 slots >= 2 * (size_t)stationCount && (slots & (slots - 1)) == 0 &&
+                 validIds(table.hashSlots, stationCount, -1) &&
+                 validOffsets(table.stationNodeOffsets, nodes) && validIds(table.stationNodeList, nodes) &&
+                 (stationCount == 0 || (textBytes > 0 && index.text.back() == '\n')) &&
+                 validIds(index.nameStart, textBytes) && validIds(index.byName, stationCount) &&
+                 validIds(index.suffixes, textBytes) && validIds(index.posToName, stationCount);
+    for (int weight : g.weights)
+        valid = valid && weight >= 0;
+    if (header->flags & SNAPSHOT_HAS_HIERARCHY)
+        valid = valid && validIds(ch.rank, nodes) && validOffsets(ch.upOffsets, header->hierarchyEdgeCount) &&
+                validIds(ch.upTargets, nodes) && validIds(ch.upMiddle, nodes, -1);
+    for (int weight : ch.upWeights)
+        valid = valid && weight >= 0;
+    // Upward edges must go up in rank and shortcuts bypass a lower node, or
+    // unpacking a shortcut might never end
+    for (int v = 0; valid && v < (int)ch.rank.size(); ++v)
+        for (int e = ch.upOffsets[v]; e < ch.upOffsets[v + 1]; ++e)
+            valid = valid && ch.rank[ch.upTargets[e]] > ch.rank[v] &&
+                    (ch.upMiddle[e] == -1 || ch.rank[ch.upMiddle[e]] < ch.rank[v]);
+    if (!valid)
+    {
+        cerr << fileName << " is corrupt\n";
+        return false;
+    }
+
+    // The bigram signatures are cheap to recompute, so they are not stored
+    string_view text = index.text;
+    index.bigrams.reserve(header->stationCount);
+    for (int start : index.nameStart)
+        index.bigrams.push_back(bigramSignature(text.substr(start, text.find('\n', start) - start)));
+
+    clearNetwork();
+    engine->stations = move(table);
+    engine->liveRouting.graph = move(g);
+    engine->liveRouting.hierarchy = move(ch);
+    engine->searchIndex = move(index);
+    return true;
+}
+
+// minuteOfDay is -1 when the travel time is not known; no period applies then
+int farePaise(const FareRules &rules, int distance, int minuteOfDay = -1)
+{
+    long long fare = 0;
+    for (const FareSlab &slab : rules.slabs)
+    {
+        if (distance <= slab.upToKm)
+        {
+            fare = slab.flatPaise + (long long)slab.paisePerKm * distance;
+            break;
+        }
+    }
+
+    for (const FarePeriod &period : rules.periods)
+    {
+        bool inside = period.fromMinute <= period.toMinute
+                          ? minuteOfDay >= period.fromMinute && minuteOfDay < period.toMinute
+                          : minuteOfDay >= period.fromMinute || (minuteOfDay >= 0 && minuteOfDay < period.toMinute);
+        if (minuteOfDay >= 0 && inside)
+        {
+            fare = (fare * period.percent + 50) / 100;
+            break;
+        }
+    }
+
+    return (int)min<long long>(max<long long>(fare, rules.minimumPaise), rules.capPaise);
+}
+
+// "HH:MM" -> minutes after midnight, or -1
+int parseClock(string_view text)
+{
+    if (text.size() != 5 || text[2] != ':' || !isdigit((unsigned char)text[0]) || !isdigit((unsigned char)text[1]) ||
+        !isdigit((unsigned char)text[3]) || !isdigit((unsigned char)text[4]))
+        return -1;
+    int hours = (text[0] - '0') * 10 + (text[1] - '0');
+    int minutes = (text[3] - '0') * 10 + (text[4] - '0');
+    return hours < 24 && minutes < 60 ? hours * 60 + minutes : -1;
+}
+
+} // namespace
+
+// Local time of day in minutes after midnight
+int currentMinuteOfDay()
+{
+    time_t now = time(nullptr);
+    tm local = *localtime(&now);
+    return local.tm_hour * 60 + local.tm_min;
+}
+
+namespace
+{
+
+// Strict amount in rupees, e.g. "32" or "10.50", as paise; false unless the
+// whole text is a number between 0 and what paise fit in an int
+bool parseRupees(const string &text, int &paise)
+{
+    if (text.empty())
+        return false;
+    char *end = nullptr;
+    double rupees = strtod(text.c_str(), &end);
+    if (*end != '\0' || !(rupees >= 0 && rupees * 100 <= INT_MAX))
+        return false;
+    paise = (int)llround(rupees * 100);
+    return true;
+}
+
+// Reads fare rules, one record per line (amounts in rupees):
+//   SLAB|<up to km>|<flat fare>[|<fare per km>]   slabs in increasing order of distance
+//   PERIOD|<HH:MM>|<HH:MM>|<percent>              e.g. PERIOD|08:00|10:00|120 for a 20% peak surcharge
+//   MINIMUM|<fare>
+//   CAP|<fare>
+// Empty lines and lines starting with '#' are ignored. The file replaces the
+// default slabs; distances beyond the last slab are charged the cap.
+bool loadFareFile(const string &fileName)
+{
+    ifstream in(fileName);
+    if (!in)
+    {
+        cerr << "Cannot open " << fileName << "\n";
+        return false;
+    }
+
+    FareRules rules;
+    rules.slabs.clear();
+    string text;
+    int lineNo = 0;
+    auto fail = [&](const string &message)
+    {
+        cerr << fileName << ":" << lineNo << ": " << message << "\n";
+        return false;
+    };
+
+    while (getline(in, text))
+    {
+        ++lineNo;
+        if (!text.empty() && text.back() == '\r')
+            text.pop_back();
+        if (text.empty() || text[0] == '#')
+            continue;
+
+        vector<string> fields = splitFields(text, '|');
+        const string &kind = fields[0];
+        if (kind == "SLAB" && (fields.size() == 3 || fields.size() == 4))
+        {
+            int upToKm = 0, flat = 0, perKm = 0;
+            if (!parseInteger(fields[1], upToKm) || upToKm < 0)
+                return fail("expected a distance in KM, got '" + fields[1] + "'");
+            if (!parseRupees(fields[2], flat) || (fields.size() == 4 && !parseRupees(fields[3], perKm)))
+                return fail("bad fare in '" + text + "'");
+            if (!rules.slabs.empty() && upToKm <= rules.slabs.back().upToKm)
+                return fail("slabs must be in increasing order of distance");
+            rules.slabs.push_back({upToKm, flat, perKm});
+        }
+        else if (kind == "PERIOD" && fields.size() == 4)
+        {
+            int from = parseClock(fields[1]);
+            int to = parseClock(fields[2]);
+            int percent = 0;
+            if (from == -1 || to == -1 || !parseInteger(fields[3], percent) || percent <= 0)
+                return fail("bad period '" + text + "'");
+            rules.periods.push_back({from, to, percent});
+        }
+        else if ((kind == "MINIMUM" || kind == "CAP") && fields.size() == 2)
+        {
+            if (!parseRupees(fields[1], kind == "MINIMUM" ? rules.minimumPaise : rules.capPaise))
+                return fail("expected an amount in rupees, got '" + fields[1] + "'");
+        }
+        else
+            return fail("unrecognised record '" + text + "'");
+    }
+
+    if (rules.slabs.empty())
+        return fail("no SLAB records");
+    // Anything beyond the last slab pays the cap
+    rules.slabs.push_back({INT_MAX, rules.capPaise, 0});
+    engine->fareRules = move(rules);
+    engine->liveRouting.version++;
+    return true;
+}
+
+// Origin-destination matrix: the distance and fare of every station pair,
+// precomputed for gate firmware and analytics that map the file and look a
+// pair up without routing. Station ids are those of the network it was
+// written from; its names are in the file to check that against.
+// Sections are 4-byte aligned and follow the header in this order:
+//   uint32 nameOffsets[stationCount + 1]   into the name bytes
+//   char   names[nameBytes]
+//   uint16 distance[stationCount * stationCount]   row = source station, OD_UNREACHABLE if not connected
+//   uint16 fare[stationCount * stationCount]       in paise (fixed point, two decimals of a rupee)
+const char OD_MATRIX_MAGIC[8] = {'M', 'E', 'T', 'R', 'O', 'O', 'D', '\0'};
+const uint32_t OD_MATRIX_VERSION = 1;
+const uint16_t OD_UNREACHABLE = 0xFFFF;
+
+struct OdMatrixHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t stationCount;
+    uint32_t nameBytes;
+};
+
+// Computes the matrix under fareRules (no time of day) with one search per
+// source station on threads workers, and writes it. Distances and fares
+// that do not fit in 16 bits fail the write.
+bool writeOdMatrix(const string &fileName, int threads)
+{
+    size_t n = engine->stations.stationCount();
+    vector<uint16_t> distance(n * n), fare(n * n);
+    atomic<bool> fits{true};
+
+    parallelFor(n, threads, [&](size_t src)
+                {
+        thread_local vector<int> dist, prev, row;
+        dijkstraToAny(stationNodes(src), IdSpan(), dist, prev);
+
+        // The nodes of a station are one per line; keep the closest
+        row.assign(n, INT_MAX);
+        for (int v = 0; v < (int)dist.size(); ++v)
+            row[engine->stations.nodeStation[v]] = min(row[engine->stations.nodeStation[v]], dist[v]);
+
+        for (size_t dst = 0; dst < n; ++dst)
+        {
+            size_t at = src * n + dst;
+            if (row[dst] == INT_MAX)
+            {
+                distance[at] = fare[at] = OD_UNREACHABLE;
+                continue;
+            }
+            int paise = farePaise(engine->fareRules, row[dst]);
+            if (row[dst] >= OD_UNREACHABLE || paise < 0 || paise >= OD_UNREACHABLE)
+                fits = false;
+            distance[at] = row[dst];
+            fare[at] = paise;
+        } });
+
+    if (!fits)
+    {
+        cerr << "Distances or fares do not fit in the 16 bits of an OD matrix entry\n";
+        return false;
+    }
+
+    OdMatrixHeader header;
+    memcpy(header.magic, OD_MATRIX_MAGIC, sizeof(header.magic));
+    header.version = OD_MATRIX_VERSION;
+    header.stationCount = n;
+    header.nameBytes = engine->stations.nameArena.size();
+
+    string out;
+    appendSection(out, &header, 1);
+    appendSection(out, engine->stations.nameOffsets.data(), engine->stations.nameOffsets.size());
+    appendSection(out, engine->stations.nameArena.data(), engine->stations.nameArena.size());
+    appendSection(out, distance.data(), distance.size());
+    appendSection(out, fare.data(), fare.size());
+
+    FILE *f = fopen(fileName.c_str(), "wb");
+    if (!f)
+    {
+        cerr << "Cannot write " << fileName << "\n";
+        return false;
+    }
+    bool ok = fwrite(out.data(), 1, out.size(), f) == out.size();
+    ok = fclose(f) == 0 && ok;
+    if (!ok)
+        cerr << "Cannot write " << fileName << "\n";
+    return ok;
+}
+
+// A matrix written by writeOdMatrix(), read in place from the mapping
+class OdMatrix
+{
+public:
+    // Maps the file and checks it was written for the loaded network. On
+    // failure the matrix loaded before stays in use.
+    bool open(const string &fileName)
+    {
+        auto mapped = make_unique<MappedFile>(fileName);
+        SnapshotReader reader(mapped->data(), mapped->size());
+
+        const OdMatrixHeader *header = reader.take<OdMatrixHeader>(1);
+        if (!header || memcmp(header->magic, OD_MATRIX_MAGIC, sizeof(OD_MATRIX_MAGIC)) != 0 || header->version != OD_MATRIX_VERSION)
+        {
+            cerr << fileName << " is not a MetroGo OD matrix\n";
+            return false;
+        }
+        size_t n = header->stationCount;
+        const uint32_t *nameOffsets = reader.take<uint32_t>(n + 1);
+        const char *names = reader.take<char>(header->nameBytes);
+        const uint16_t *newDistances = reader.take<uint16_t>(n * n);
+        const uint16_t *newFares = reader.take<uint16_t>(n * n);
+        if (!reader.ok)
+        {
+            cerr << fileName << " is truncated\n";
+            return false;
+        }
+
+        if (n != (size_t)engine->stations.stationCount() || string_view(names, header->nameBytes) != engine->stations.nameArena ||
+            !equal(nameOffsets, nameOffsets + n + 1, engine->stations.nameOffsets.begin()))
+        {
+            cerr << fileName << " was written for another network\n";
+            return false;
+        }
+        file = move(mapped);
+        distances = newDistances;
+        fares = newFares;
+        stationCount = n;
+        return true;
+    }
+
+    bool empty() const { return stationCount == 0; }
+
+    // Station-level distance, or OD_UNREACHABLE
+    int distance(int src, int dst) const { return distances[(size_t)src * stationCount + dst]; }
+
+    int farePaise(int src, int dst) const { return fares[(size_t)src * stationCount + dst]; }
+
+private:
+    unique_ptr<MappedFile> file;
+    size_t stationCount = 0;
+    const uint16_t *distances = nullptr;
+    const uint16_t *fares = nullptr;
+};
+
+// Bounded cache of station-to-station routes for skewed traffic, where a few
+// hundred origin-destination pairs make up most queries. Entries are spread
+// over independently locked shards and evicted with the CLOCK algorithm: a
+// hit sets the entry's reference bit and the clock hand only evicts entries
+// whose bit is clear, clearing bits as it passes. Every entry belongs to one
+// RoutingState::version; a shard that sees a newer version drops all its
+// entries, and a query routing on an older one neither hits nor inserts.
+class RouteCache
+{
+public:
+    struct Stats
+    {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        size_t entries;
+    };
+
+    explicit RouteCache(size_t capacity) { setCapacity(capacity); }
+
+    // Empties the cache. Not safe while other threads use it.
+    void setCapacity(size_t capacity)
+    {
+        perShard = (capacity + SHARDS - 1) / SHARDS;
+        for (Shard &shard : shards)
+            shard.reset(0);
+        hits = misses = evictions = 0;
+    }
+
+    bool enabled() const { return perShard > 0; }
+
+    // On a hit copies the route into distance, farePaise and path
+    bool lookup(int source, int destination, uint64_t version, int &distance, int &farePaise, vector<int> &path)
+    {
+        uint64_t key = makeKey(source, destination);
+        Shard &shard = shardOf(key);
+        lock_guard<mutex> lock(shard.m);
+        if (shard.version < version)
+            shard.reset(version);
+
+        auto it = shard.index.find(key);
+        if (shard.version != version || it == shard.index.end())
+        {
+            misses++;
+            return false;
+        }
+        Entry &entry = shard.entries[it->second];
+        entry.referenced = true;
+        distance = entry.distance;
+        farePaise = entry.farePaise;
+        path.assign(entry.path.begin(), entry.path.end());
+        hits++;
+        return true;
+    }
+
+    void insert(int source, int destination, uint64_t version, int distance, int farePaise, IdSpan path)
+    {
+        if (!enabled())
+            return;
+        uint64_t key = makeKey(source, destination);
+        Shard &shard = shardOf(key);
+        lock_guard<mutex> lock(shard.m);
+        if (shard.version < version)
+            shard.reset(version);
+        if (shard.version != version || shard.index.count(key))
+            return; // another thread got here first, or the route is outdated
+
+        size_t slot;
+        if (shard.entries.size() < perShard)
+        {
+            slot = shard.entries.size();
+            shard.entries.emplace_back();
+        }
+        else
+        {
+            // Give referenced entries a second chance
+            while (shard.entries[shard.hand].referenced)
+            {
+                shard.entries[shard.hand].referenced = false;
+                shard.hand = (shard.hand + 1) % shard.entries.size();
+            }
+            slot = shard.hand;
+            shard.hand = (shard.hand + 1) % shard.entries.size();
+            if (shard.entries[slot].key != UNUSED_KEY)
+            {
+                shard.index.erase(shard.entries[slot].key);
+                evictions++;
+            }
+        }
+
+        Entry &entry = shard.entries[slot];
+        entry.key = key;
+        entry.distance = distance;
+        entry.farePaise = farePaise;
+        entry.referenced = false;
+        entry.path.assign(path.begin(), path.end());
+        shard.index[key] = slot;
+    }
+
+    // Moves the routes of version from to version to, dropping those whose
+    // path uses the edge between nodes a and b in either direction. The
+    // others stay valid when that edge only got longer, since no other
+    // route got shorter. Returns the number dropped.
+    size_t carryOver(uint64_t from, uint64_t to, int a, int b)
+    {
+        size_t dropped = 0;
+        for (Shard &shard : shards)
+        {
+            lock_guard<mutex> lock(shard.m);
+            if (shard.version != from)
+                continue; // dropped anyway on its next use
+            shard.version = to;
+            for (Entry &entry : shard.entries)
+            {
+                bool uses = false;
+                for (size_t i = 1; i < entry.path.size() && !uses; ++i)
+                    uses = (entry.path[i - 1] == a && entry.path[i] == b) || (entry.path[i - 1] == b && entry.path[i] == a);
+                if (!uses)
+                    continue;
+
+                // The slot stays in the clock ring and is the first to be reused
+                shard.index.erase(entry.key);
+                entry.key = UNUSED_KEY;
+                entry.referenced = false;
+                entry.path.clear();
+                dropped++;
+            }
+        }
+        return dropped;
+    }
+
+    Stats stats()
+    {
+        size_t entries = 0;
+        for (Shard &shard : shards)
+        {
+            lock_guard<mutex> lock(shard.m);
+            entries += shard.index.size();
+        }
+        return {hits, misses, evictions, entries};
+    }
+
+private:
+    static const int SHARDS = 16;
+
+    // Key of a slot whose route was dropped; no station pair maps to it
+    static const uint64_t UNUSED_KEY = ~0ull;
+
+    struct Entry
+    {
+        uint64_t key;
+        int distance;
+        int farePaise;
+        bool referenced;
+        vector<int> path;
+    };
+
+    struct Shard
+    {
+        mutex m;
+        uint64_t version = 0;
+        vector<Entry> entries;
+        unordered_map<uint64_t, size_t> index;
+        size_t hand = 0;
+
+        void reset(uint64_t newVersion)
+        {
+            version = newVersion;
+            entries.clear();
+            index.clear();
+            hand = 0;
+        }
+    };
+
+    static uint64_t makeKey(int source, int destination)
+    {
+        return (uint64_t)(uint32_t)source << 32 | (uint32_t)destination;
+    }
+
+    Shard &shardOf(uint64_t key)
+    {
+        return shards[(key * 0x9E3779B97F4A7C15ull) >> 60];
+    }
+
+    size_t perShard = 0;
+    Shard shards[SHARDS];
+    atomic<uint64_t> hits{0}, misses{0}, evictions{0};
+};
+
+// Hit-rate line for the stderr summaries
+void printRouteCacheStats()
+{
+    if (!engine->routeCache->enabled())
+        return;
+    RouteCache::Stats stats = engine->routeCache->stats();
+    uint64_t lookups = stats.hits + stats.misses;
+    fprintf(stderr, "Route cache: %llu of %llu lookups hit (%.1f%%), %zu entries, %llu evictions\n",
+            (unsigned long long)stats.hits, (unsigned long long)lookups, lookups ? 100.0 * stats.hits / lookups : 0.0,
+            stats.entries, (unsigned long long)stats.evictions);
+}
+
+// Shortest route between two stations, without any console output
+struct RouteResult
+{
+    int distance;  // INT_MAX if the stations are not connected
+    int farePaise; // under fareRules with no time of day
+    IdSpan path;   // node ids, valid until the next query on this thread
+};
+
+// One search seeded with every node of the source station (one per line it
+// is on) that stops at the first node of the destination station.
+// Uses the contraction hierarchy when one has been built, else ALT landmarks
+// or a bidirectional search when enabled, and answers repeated pairs from
+// routeCache.
+// Both must be valid station ids, see findStation().
+RouteResult shortestRoute(int srcStation, int destStation)
+{
+    TIME_OPERATION(Operation::ShortestPath);
+    RouteResult route;
+    route.distance = INT_MAX;
+    route.farePaise = 0;
+
+    // Reused by every query on this thread
+    thread_local vector<int> dist, prev, pathNodes;
+    pathNodes.clear();
+
+    const RoutingState &state = *routing;
+    uint64_t version = state.version;
+    if (engine->routeCache->enabled() && engine->routeCache->lookup(srcStation, destStation, version, route.distance, route.farePaise, pathNodes))
+    {
+        route.path = pathNodes;
+        return route;
+    }
+
+    IdSpan srcNodes = stationNodes(srcStation);
+    IdSpan destNodes = stationNodes(destStation);
+
+    if (!state.hierarchy.empty())
+    {
+        route.distance = hierarchyRoute(srcNodes, destNodes, &pathNodes);
+    }
+    else if (!state.landmarkTable.empty())
+    {
+        route.distance = altRoute(srcNodes, destNodes, &pathNodes);
+    }
+    else if (engine->bidirectionalSearch)
+    {
+        route.distance = bidirectionalRoute(srcNodes, destNodes, &pathNodes);
+    }
+    else
+    {
+        int reached = dijkstraToAny(srcNodes, destNodes, dist, prev);
+        if (reached != -1)
+        {
+            route.distance = dist[reached];
+            for (int at = reached; at != -1; at = prev[at])
+                pathNodes.push_back(at);
+            reverse(pathNodes.begin(), pathNodes.end());
+        }
+    }
+
+    route.path = pathNodes;
+    if (!route.path.empty())
+        route.farePaise = farePaise(engine->fareRules, route.distance);
+    engine->routeCache->insert(srcStation, destStation, version, route.distance, route.farePaise, route.path);
+    return route;
+}
+
+// Yen's algorithm enumerates up to this many times the requested number of
+// routes before the similarity ranking picks among them
+const int ALTERNATIVE_POOL_FACTOR = 3;
+
+// Routes longer than this multiple of the shortest, or than the shortest
+// plus ALTERNATIVE_MIN_DETOUR for short trips, are not offered
+const double ALTERNATIVE_MAX_STRETCH = 1.5;
+const int ALTERNATIVE_MIN_DETOUR = 10;
+
+// A route whose whole length runs over segments of routes already picked
+// ranks as if it were this much longer (in proportion to the shared part)
+const double ALTERNATIVE_OVERLAP_PENALTY = 1.0;
+
+// Up to k loopless routes between two stations, best first: the shortest,
+// then alternatives ranked by length with a penalty for overlapping the
+// routes ranked above them. No alternative visits a station twice, and
+// routes that only differ in where lines are changed at one station count
+// as the same route.
+//
+// Candidates come from Yen's algorithm. One Dijkstra from the destination
+// gives every node's exact distance to it on the whole graph; the first
+// route follows that tree and every spur search is an A* with it as
+// potential, which stays consistent with nodes and edges blocked. A spur
+// that is not blocked on its way therefore settles little more than its
+// own path.
+vector<AlternativeRoute> alternativeRoutes(int srcStation, int destStation, int k)
+{
+    TIME_OPERATION(Operation::AlternativeRoutes);
+    const CsrGraph &graph = routing->graph;
+    int n = graph.size();
+    vector<AlternativeRoute> result;
+    if (k <= 0)
+        return result;
+
+    IdSpan srcNodes = stationNodes(srcStation);
+    IdSpan destNodes = stationNodes(destStation);
+
+    // toDest[v] is the distance from v to the destination, towardsDest[v] the next node on the way
+    vector<int> toDest, towardsDest;
+    dijkstraToAny(destNodes, IdSpan(), toDest, towardsDest);
+
+    int start = -1;
+    for (int s : srcNodes)
+        if (toDest[s] != INT_MAX && (start == -1 || toDest[s] < toDest[start]))
+            start = s;
+    if (start == -1)
+        return result;
+    int shortest = toDest[start];
+    long long maxDistance = max((long long)(shortest * ALTERNATIVE_MAX_STRETCH), (long long)shortest + ALTERNATIVE_MIN_DETOUR);
+
+    auto stationsOf = [&](const vector<int> &path)
+    {
+        vector<int> sequence;
+        for (int v : path)
+            if (sequence.empty() || sequence.back() != engine->stations.nodeStation[v])
+                sequence.push_back(engine->stations.nodeStation[v]);
+        return sequence;
+    };
+    auto hop = [&](int u, int v)
+    {
+        for (int e = graph.offsets[u]; e < graph.offsets[u + 1]; ++e)
+            if (graph.targets[e] == v)
+                return graph.weights[e];
+        return 0;
+    };
+
+    vector<int> first;
+    for (int v = start; v != -1; v = towardsDest[v])
+        first.push_back(v);
+
+    // Node paths taken off the candidates in order of length, the ones among
+    // them to offer, the candidates waiting, and every node path and station
+    // sequence seen so far. A path that repeats a known station sequence or
+    // passes a station twice (a spur is only loopless over nodes) is not
+    // offered but is still spurred from, or the routes that only deviate
+    // from it would be missed.
+    vector<vector<int>> found = {first};
+    vector<int> foundDistance = {shortest};
+    vector<int> distinct = {0};
+    priority_queue<pair<long long, vector<int>>, vector<pair<long long, vector<int>>>, greater<>> candidates;
+    set<vector<int>> seenPaths = {first};
+    set<vector<int>> seenSequences = {stationsOf(first)};
+
+    // A* state, reset through the touched list after every spur search
+    vector<int> dist(n, INT_MAX), parent(n, -1), blocked(n, 0), touched;
+    vector<pair<long long, int>> heap;
+    greater<pair<long long, int>> cmp;
+    int stamp = 0;
+
+    size_t pool = (size_t)k * ALTERNATIVE_POOL_FACTOR;
+    while (distinct.size() < pool)
+    {
+        const vector<int> last = found.back();
+
+        // Spur from every node of the last route but the final one, and
+        // (as index -1) from the source nodes no accepted route starts at
+        long long rootLength = 0;
+        for (int i = -1; i + 1 < (int)last.size(); ++i)
+        {
+            if (i > 0)
+                rootLength += hop(last[i - 1], last[i]);
+            stamp++;
+
+            // The root may not be revisited: block its stations, except the
+            // spur station's nodes that the root did not pass through
+            int spurStation = i == -1 ? srcStation : engine->stations.nodeStation[last[i]];
+            for (int j = 0; j < i; ++j)
+            {
+                int station = engine->stations.nodeStation[last[j]];
+                if (station == spurStation)
+                    blocked[last[j]] = stamp;
+                else
+                    for (int v : stationNodes(station))
+                        blocked[v] = stamp;
+            }
+
+            // Next nodes of accepted routes with the same root: edges out of
+            // the spur node, or at index -1 the first nodes
+            vector<int> blockedHeads;
+            for (const vector<int> &route : found)
+                if ((int)route.size() > i + 1 && equal(last.begin(), last.begin() + i + 1, route.begin()))
+                    blockedHeads.push_back(route[i + 1]);
+            auto isBlockedHead = [&](int v)
+            { return find(blockedHeads.begin(), blockedHeads.end(), v) != blockedHeads.end(); };
+
+            auto seed = [&](int v)
+            {
+                if (dist[v] == 0 || toDest[v] == INT_MAX)
+                    return;
+                dist[v] = 0;
+                touched.push_back(v);
+                COUNT_WORK(heapPushes, 1);
+                heap.push_back({toDest[v], v});
+            };
+            if (i == -1)
+            {
+                for (int s : srcNodes)
+                    if (!isBlockedHead(s))
+                        seed(s);
+            }
+            else
+            {
+                seed(last[i]);
+            }
+            make_heap(heap.begin(), heap.end(), cmp);
+
+            int reached = -1;
+            while (!heap.empty())
+            {
+                pop_heap(heap.begin(), heap.end(), cmp);
+                auto [key, u] = heap.back();
+                heap.pop_back();
+                if (key - toDest[u] > dist[u])
+                    continue;
+                settledNodes++;
+                if (rootLength + key > maxDistance)
+                    break;
+                if (engine->stations.nodeStation[u] == destStation)
+                {
+                    reached = u;
+                    break;
+                }
+
+                COUNT_WORK(edgesRelaxed, graph.offsets[u + 1] - graph.offsets[u]);
+                for (int e = graph.offsets[u]; e < graph.offsets[u + 1]; ++e)
+                {
+                    int v = graph.targets[e];
+                    if (graph.weights[e] == CLOSED_EDGE || blocked[v] == stamp || toDest[v] == INT_MAX)
+                        continue;
+                    if (i != -1 && u == last[i] && isBlockedHead(v))
+                        continue;
+                    int nd = dist[u] + graph.weights[e];
+                    if (nd < dist[v])
+                    {
+                        if (dist[v] == INT_MAX)
+                            touched.push_back(v);
+                        dist[v] = nd;
+                        parent[v] = u;
+                        COUNT_WORK(heapPushes, 1);
+                        heap.push_back({(long long)nd + toDest[v], v});
+                        push_heap(heap.begin(), heap.end(), cmp);
+                    }
+                }
+            }
+
+            if (reached != -1)
+            {
+                vector<int> spur;
+                for (int at = reached; at != -1; at = parent[at])
+                    spur.push_back(at);
+                reverse(spur.begin(), spur.end());
+
+                vector<int> candidate(last.begin(), last.begin() + max(i, 0));
+                candidate.insert(candidate.end(), spur.begin(), spur.end());
+                long long length = rootLength + dist[reached];
+                if (seenPaths.insert(candidate).second)
+                    candidates.push({length, move(candidate)});
+            }
+
+            for (int v : touched)
+            {
+                dist[v] = INT_MAX;
+                parent[v] = -1;
+            }
+            touched.clear();
+            heap.clear();
+        }
+
+        if (candidates.empty())
+            break;
+        auto [length, path] = candidates.top();
+        candidates.pop();
+        vector<int> sequence = stationsOf(path);
+        if (set<int>(sequence.begin(), sequence.end()).size() == sequence.size() && seenSequences.insert(sequence).second)
+            distinct.push_back(found.size());
+        found.push_back(move(path));
+        foundDistance.push_back(length);
+    }
+
+    // Rank: each time the route with the lowest penalised length among
+    // those left, against the segments of the routes ranked so far
+    set<pair<int, int>> usedSegments;
+    vector<bool> taken(found.size(), false);
+    while ((int)result.size() < k && result.size() < distinct.size())
+    {
+        int best = -1;
+        double bestScore = 0, bestShared = 0;
+        for (int r : distinct)
+        {
+            if (taken[r])
+                continue;
+            long long sharedLength = 0;
+            for (size_t i = 1; i < found[r].size(); ++i)
+            {
+                int a = engine->stations.nodeStation[found[r][i - 1]], b = engine->stations.nodeStation[found[r][i]];
+                if (a != b && usedSegments.count({min(a, b), max(a, b)}))
+                    sharedLength += hop(found[r][i - 1], found[r][i]);
+            }
+            double shared = foundDistance[r] > 0 ? (double)sharedLength / foundDistance[r] : 0;
+            double score = foundDistance[r] * (1 + ALTERNATIVE_OVERLAP_PENALTY * shared);
+            if (best == -1 || score < bestScore)
+            {
+                best = r;
+                bestScore = score;
+                bestShared = shared;
+            }
+        }
+
+        taken[best] = true;
+        const vector<int> &path = found[best];
+        for (size_t i = 1; i < path.size(); ++i)
+        {
+            int a = engine->stations.nodeStation[path[i - 1]], b = engine->stations.nodeStation[path[i]];
+            if (a != b)
+                usedSegments.insert({min(a, b), max(a, b)});
+        }
+        result.push_back({foundDistance[best], bestShared, path});
+    }
+    return result;
+}
+
+// Every route between two stations that no other route beats on both
+// distance and line changes, shortest (and so with the most changes) first;
+// the last one has the fewest changes possible. A change is a move between
+// nodes of different line prefixes, see StationTable::nodeLine; its
+// interchange edge weight is not counted as distance.
+//
+// One label-setting search finds the whole front. A label is a node reached
+// with some (distance, changes), popped in order of distance and then
+// changes. Labels settle at a node in order of distance, so a label is only
+// worth keeping if it has fewer changes than every label settled there
+// before it: the front of a node is a staircase, and one int per node (the
+// fewest changes settled so far) is the whole dominance check. The same
+// test against the destination prunes everything that cannot improve the
+// answer. A node settles at most once per distinct change count on its front,
+// which on a metro network is a handful.
+vector<ParetoRoute> paretoRoutes(int srcStation, int destStation)
+{
+    TIME_OPERATION(Operation::ParetoRoutes);
+    const CsrGraph &graph = routing->graph;
+    int n = graph.size();
+    vector<ParetoRoute> result;
+
+    // fewestTransfers[v] for the labels settled at v; INT_MAX until the first
+    thread_local vector<int> fewestTransfers;
+    fewestTransfers.assign(n, INT_MAX);
+    int destFewest = INT_MAX;
+
+    // Labels are {node, parent label}; the heap holds {distance << 32 | changes, label}
+    thread_local vector<pair<int, int>> labels;
+    thread_local vector<pair<uint64_t, int>> heap;
+    greater<pair<uint64_t, int>> cmp;
+    labels.clear();
+    heap.clear();
+
+    auto push = [&](int v, uint64_t distance, int transfers, int parent)
+    {
+        if (transfers >= fewestTransfers[v] || transfers >= destFewest)
+            return;
+        labels.push_back({v, parent});
+        COUNT_WORK(heapPushes, 1);
+        heap.push_back({distance << 32 | (uint32_t)transfers, (int)labels.size() - 1});
+        push_heap(heap.begin(), heap.end(), cmp);
+    };
+    for (int s : stationNodes(srcStation))
+        push(s, 0, 0, -1);
+
+    while (!heap.empty())
+    {
+        pop_heap(heap.begin(), heap.end(), cmp);
+        auto [key, label] = heap.back();
+        heap.pop_back();
+        int u = labels[label].first;
+        uint64_t distance = key >> 32;
+        int transfers = (uint32_t)key;
+
+        // Dominated by a label settled since this one was pushed
+        if (transfers >= fewestTransfers[u] || transfers >= destFewest)
+            continue;
+        fewestTransfers[u] = transfers;
+        settledNodes++;
+
+        if (engine->stations.nodeStation[u] == destStation)
+        {
+            destFewest = transfers;
+            ParetoRoute route{(int)distance, transfers, {}};
+            for (int at = label; at != -1; at = labels[at].second)
+                route.path.push_back(labels[at].first);
+            reverse(route.path.begin(), route.path.end());
+            result.push_back(move(route));
+            if (transfers == 0)
+                break;
+            continue;
+        }
+
+        COUNT_WORK(edgesRelaxed, graph.offsets[u + 1] - graph.offsets[u]);
+        for (int e = graph.offsets[u]; e < graph.offsets[u + 1]; ++e)
+        {
+            int v = graph.targets[e];
+            if (graph.weights[e] == CLOSED_EDGE)
+                continue;
+            bool change = engine->stations.nodeLine[v] != engine->stations.nodeLine[u];
+            bool ride = engine->stations.nodeStation[v] != engine->stations.nodeStation[u];
+            push(v, distance + (ride ? graph.weights[e] : 0), transfers + change, label);
+        }
+    }
+    return result;
+}
+
+// Stations within radius of srcStation (itself included, at 0) with their
+// distances, in station id order. A Dijkstra that stops at the radius; its distances
+// are reset through the nodes it touched, so the cost only depends on how
+// much of the network is within reach.
+vector<StationDistance> reachableStations(int srcStation, int radius)
+{
+    TIME_OPERATION(Operation::ReachableStations);
+    const CsrGraph &graph = routing->graph;
+    int n = graph.size();
+    vector<StationDistance> result;
+
+    thread_local vector<int> dist, touched;
+    thread_local vector<pair<int, int>> heap;
+    // Stations already listed carry the stamp of this call, as in dijkstraToAny()
+    thread_local vector<unsigned> stationMark;
+    thread_local unsigned stamp = 0;
+    if (dist.size() != (size_t)n)
+        dist.assign(n, INT_MAX);
+    if (stationMark.size() != (size_t)engine->stations.stationCount())
+    {
+        stationMark.assign(engine->stations.stationCount(), 0);
+        stamp = 0;
+    }
+    if (++stamp == 0)
+    {
+        fill(stationMark.begin(), stationMark.end(), 0);
+        stamp = 1;
+    }
+    greater<pair<int, int>> cmp;
+    heap.clear();
+
+    for (int s : stationNodes(srcStation))
+    {
+        dist[s] = 0;
+        touched.push_back(s);
+        COUNT_WORK(heapPushes, 1);
+        heap.push_back({0, s});
+    }
+    make_heap(heap.begin(), heap.end(), cmp);
+
+    while (!heap.empty())
+    {
+        pop_heap(heap.begin(), heap.end(), cmp);
+        auto [d, u] = heap.back();
+        heap.pop_back();
+        if (d > dist[u])
+            continue;
+        settledNodes++;
+
+        // Nodes settle in order of distance, so a station's first is its distance
+        int station = engine->stations.nodeStation[u];
+        if (stationMark[station] != stamp)
+        {
+            stationMark[station] = stamp;
+            result.push_back({station, d});
+        }
+
+        COUNT_WORK(edgesRelaxed, graph.offsets[u + 1] - graph.offsets[u]);
+        for (int e = graph.offsets[u]; e < graph.offsets[u + 1]; ++e)
+        {
+            int v = graph.targets[e];
+            long long newDist = (long long)d + graph.weights[e];
+            if (newDist <= radius && newDist < dist[v])
+            {
+                if (dist[v] == INT_MAX)
+                    touched.push_back(v);
+                dist[v] = newDist;
+                COUNT_WORK(heapPushes, 1);
+                heap.push_back({dist[v], v});
+                push_heap(heap.begin(), heap.end(), cmp);
+            }
+        }
+    }
+
+    for (int v : touched)
+        dist[v] = INT_MAX;
+    touched.clear();
+
+    sort(result.begin(), result.end(), [](const StationDistance &a, const StationDistance &b)
+         { return a.station < b.station; });
+    return result;
+}
+
+// Origins searched together by reachableFromEach, one per lane
+const int ISOCHRONE_LANES = 8;
+
+// Distance of a node from each origin of a group; UNREACHED beyond the radius
+struct alignas(32) LaneDistances
+{
+    int lane[ISOCHRONE_LANES];
+};
+const int UNREACHED = INT_MAX / 2;
+
+// Searches up to ISOCHRONE_LANES origins at once for reachableFromEach().
+//
+// The group shares one search: every node holds its distance from each
+// origin and an edge is relaxed for all of them in one fixed-length loop
+// the compiler turns into vector instructions, so nodes near several
+// origins are visited once instead of once per origin. Lanes improve at
+// different times, which makes this label-correcting: a node goes back into
+// the queue whenever any lane improves, keyed by the smallest lane that did.
+void reachableFromGroup(const int *srcStations, int lanes, int radius, vector<StationDistance> *result)
+{
+    TIME_OPERATION(Operation::ReachableFromEach);
+    const CsrGraph &graph = routing->graph;
+    int n = graph.size();
+
+    // queuedKey[v] is the key v waits in the heap with, or UNREACHED
+    thread_local vector<LaneDistances> dist, stationDist;
+    thread_local vector<int> queuedKey, touched, touchedStations;
+    thread_local vector<char> isTouched;
+    thread_local vector<pair<int, int>> heap;
+    LaneDistances unreached;
+    fill(begin(unreached.lane), end(unreached.lane), UNREACHED);
+    if (dist.size() != (size_t)n)
+    {
+        dist.assign(n, unreached);
+        queuedKey.assign(n, UNREACHED);
+        isTouched.assign(n, 0);
+    }
+    if (stationDist.size() != (size_t)engine->stations.stationCount())
+        stationDist.assign(engine->stations.stationCount(), unreached);
+    greater<pair<int, int>> cmp;
+    heap.clear();
+
+    auto enqueue = [&](int v, int key)
+    {
+        if (!isTouched[v])
+        {
+            isTouched[v] = 1;
+            touched.push_back(v);
+        }
+        if (key >= queuedKey[v])
+            return;
+        queuedKey[v] = key;
+        COUNT_WORK(heapPushes, 1);
+        heap.push_back({key, v});
+        push_heap(heap.begin(), heap.end(), cmp);
+    };
+    for (int l = 0; l < lanes; ++l)
+        for (int s : stationNodes(srcStations[l]))
+        {
+            dist[s].lane[l] = 0;
+            enqueue(s, 0);
+        }
+
+    while (!heap.empty())
+    {
+        pop_heap(heap.begin(), heap.end(), cmp);
+        auto [key, u] = heap.back();
+        heap.pop_back();
+        if (key != queuedKey[u])
+            continue;
+        queuedKey[u] = UNREACHED;
+        settledNodes++;
+
+        // A copy, so the compiler knows the lanes written below are not read
+        COUNT_WORK(edgesRelaxed, graph.offsets[u + 1] - graph.offsets[u]);
+        const LaneDistances from = dist[u];
+        for (int e = graph.offsets[u]; e < graph.offsets[u + 1]; ++e)
+        {
+            int w = graph.weights[e];
+            if (w > radius)
+                continue;
+            int v = graph.targets[e];
+            LaneDistances &to = dist[v];
+            int improved = UNREACHED;
+            for (int l = 0; l < ISOCHRONE_LANES; ++l)
+            {
+                int d = from.lane[l] + w;
+                d = d <= radius ? d : UNREACHED;
+                improved = min(improved, d < to.lane[l] ? d : UNREACHED);
+                to.lane[l] = min(to.lane[l], d);
+            }
+            if (improved != UNREACHED)
+                enqueue(v, improved);
+        }
+    }
+
+    // Smallest distance over a station's nodes, for every lane at once
+    for (int v : touched)
+    {
+        int station = engine->stations.nodeStation[v];
+        LaneDistances &best = stationDist[station];
+        if (best.lane[0] == UNREACHED && equal(begin(best.lane), end(best.lane), begin(unreached.lane)))
+            touchedStations.push_back(station);
+        for (int l = 0; l < ISOCHRONE_LANES; ++l)
+            best.lane[l] = min(best.lane[l], dist[v].lane[l]);
+    }
+    sort(touchedStations.begin(), touchedStations.end());
+    for (int l = 0; l < lanes; ++l)
+    {
+        result[l].clear();
+        for (int station : touchedStations)
+            if (stationDist[station].lane[l] != UNREACHED)
+                result[l].push_back({station, stationDist[station].lane[l]});
+    }
+
+    for (int station : touchedStations)
+        stationDist[station] = unreached;
+    touchedStations.clear();
+    for (int v : touched)
+    {
+        dist[v] = unreached;
+        queuedKey[v] = UNREACHED;
+        isTouched[v] = 0;
+    }
+    touched.clear();
+}
+
+// reachableStations() for many origins: result[i] lists the stations within
+// radius of srcStations[i], in the same order. Origins are searched
+// ISOCHRONE_LANES at a time (see reachableFromGroup) over threads workers.
+// A group only saves work where its origins' reach overlaps, so they are
+// grouped in order of their first node: nodes are numbered along the lines,
+// which puts neighbours on a line in the same group.
+vector<vector<StationDistance>> reachableFromEach(const vector<int> &srcStations, int radius, int threads = 1)
+{
+    vector<int> order(srcStations.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    sort(order.begin(), order.end(), [&](int a, int b)
+         { return stationNodes(srcStations[a])[0] < stationNodes(srcStations[b])[0]; });
+    vector<int> sorted;
+    for (int i : order)
+        sorted.push_back(srcStations[i]);
+
+    vector<vector<StationDistance>> reached(srcStations.size());
+    size_t groups = (srcStations.size() + ISOCHRONE_LANES - 1) / ISOCHRONE_LANES;
+    parallelFor(groups, threads, [&](size_t group)
+                {
+        size_t first = group * ISOCHRONE_LANES;
+        int lanes = min<size_t>(ISOCHRONE_LANES, sorted.size() - first);
+        reachableFromGroup(&sorted[first], lanes, radius, &reached[first]); });
+
+    vector<vector<StationDistance>> result(srcStations.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        result[order[i]] = move(reached[i]);
+    return result;
+}
+
+// Live disruptions: a segment closed or slowed down, or the transfers at an
+// interchange suspended, while the network is in use. Nothing is rebuilt;
+// every changed edge repairs what was worked out over its old weight:
+//   - the route cache only drops the routes through an edge that got
+//     longer, as no other route changes; a shorter edge may improve any
+//     route, so then the whole cache goes with the old version
+//   - the landmark tables are repaired by a dynamic Dijkstra that only
+//     visits the nodes whose distance to the landmark can change
+//   - the contraction hierarchy cannot be patched that way, so it is
+//     dropped and routes fall back to the landmarks or a plain search until
+//     buildContractionHierarchy() is run again
+// All of this changes liveRouting, so nothing may route on it meanwhile;
+// runBatch applies disruptions between blocks and runServer publishes a
+// copy after each one. The timetable is a separate schedule and is not
+// affected.
+
+// Index of the edge from -> to in the arrays of graph, or -1
+int findEdge(const CsrGraph &graph, int from, int to)
+{
+    for (int e = graph.offsets[from]; e < graph.offsets[from + 1]; ++e)
+        if (graph.targets[e] == to)
+            return e;
+    return -1;
+}
+
+// Brings the tree of landmark i up to date after the edge u-v changed from
+// oldWeight to newWeight (either may be CLOSED_EDGE). A longer edge only
+// matters if it is a tree edge: the subtree below it loses its distances
+// and is settled again from its neighbours outside. A shorter edge is
+// relaxed in both directions and the improvement spreads from there.
+void repairLandmark(size_t i, int u, int v, int oldWeight, int newWeight)
+{
+    const CsrGraph &graph = engine->liveRouting.graph;
+    LandmarkTable &landmarkTable = engine->liveRouting.landmarkTable;
+    size_t k = landmarkTable.landmarks.size();
+    int *dist = landmarkTable.dist.data() + i;
+    int *parent = landmarkTable.parent.data() + i;
+    auto at = [k](int *column, int node) -> int &
+    { return column[(size_t)node * k]; };
+
+    vector<pair<int, int>> heap; // {distance, node}
+    greater<pair<int, int>> cmp;
+
+    if (newWeight > oldWeight)
+    {
+        int root = at(parent, v) == u ? v : at(parent, u) == v ? u
+                                                                : -1;
+        if (root == -1)
+            return;
+
+        vector<int> subtree = {root};
+        for (size_t j = 0; j < subtree.size(); ++j)
+            for (int e = graph.offsets[subtree[j]]; e < graph.offsets[subtree[j] + 1]; ++e)
+                if (at(parent, graph.targets[e]) == subtree[j])
+                    subtree.push_back(graph.targets[e]);
+        for (int x : subtree)
+        {
+            at(dist, x) = INT_MAX;
+            at(parent, x) = -1;
+        }
+
+        // Best way into the subtree from every untouched neighbour
+        for (int x : subtree)
+        {
+            for (int e = graph.offsets[x]; e < graph.offsets[x + 1]; ++e)
+            {
+                int y = graph.targets[e];
+                if (graph.weights[e] == CLOSED_EDGE || at(dist, y) == INT_MAX)
+                    continue;
+                if (at(dist, y) + graph.weights[e] < at(dist, x))
+                {
+                    at(dist, x) = at(dist, y) + graph.weights[e];
+                    at(parent, x) = y;
+                }
+            }
+            if (at(dist, x) != INT_MAX)
+                heap.push_back({at(dist, x), x});
+        }
+        make_heap(heap.begin(), heap.end(), cmp);
+    }
+    else
+    {
+        for (auto [a, b] : {make_pair(u, v), make_pair(v, u)})
+        {
+            if (at(dist, a) != INT_MAX && at(dist, a) + newWeight < at(dist, b))
+            {
+                at(dist, b) = at(dist, a) + newWeight;
+                at(parent, b) = a;
+                heap.push_back({at(dist, b), b});
+                push_heap(heap.begin(), heap.end(), cmp);
+            }
+        }
+    }
+
+    while (!heap.empty())
+    {
+        pop_heap(heap.begin(), heap.end(), cmp);
+        auto [d, x] = heap.back();
+        heap.pop_back();
+        if (d > at(dist, x))
+            continue;
+        settledNodes++;
+
+        for (int e = graph.offsets[x]; e < graph.offsets[x + 1]; ++e)
+        {
+            if (graph.weights[e] == CLOSED_EDGE)
+                continue;
+            int y = graph.targets[e];
+            int nd = d + graph.weights[e];
+            if (nd < at(dist, y))
+            {
+                at(dist, y) = nd;
+                at(parent, y) = x;
+                heap.push_back({nd, y});
+                push_heap(heap.begin(), heap.end(), cmp);
+            }
+        }
+    }
+}
+
+// Sets the weight of the edge u-v in both directions (CLOSED_EDGE closes
+// it) and repairs everything derived from the old weight, see above
+void setEdgeWeight(int u, int v, int weight)
+{
+    CsrGraph &graph = engine->liveRouting.graph;
+    int forward = findEdge(graph, u, v);
+    int backward = findEdge(graph, v, u);
+    int oldWeight = graph.weights[forward];
+    if (weight == oldWeight)
+        return;
+
+    if (graph.plannedWeights.empty())
+        graph.plannedWeights = graph.weights;
+    graph.weights[forward] = weight;
+    graph.weights[backward] = weight;
+
+    for (size_t i = 0; i < engine->liveRouting.landmarkTable.landmarks.size(); ++i)
+        repairLandmark(i, u, v, oldWeight, weight);
+    if (!engine->liveRouting.hierarchy.empty())
+        engine->liveRouting.hierarchy = ContractionHierarchy();
+    uint64_t oldVersion = engine->liveRouting.version++;
+    if (weight > oldWeight)
+        engine->routeCache->carryOver(oldVersion, engine->liveRouting.version, u, v);
+}
+
+// Sets every edge between a node of station a and a node of station b, or
+// with a == b every interchange edge of that station. weight -1 restores
+// the weights the network was built with. Returns the number of edges.
+int setStationEdges(int a, int b, int weight)
+{
+    const CsrGraph &graph = engine->liveRouting.graph;
+    int count = 0;
+    for (int u : stationNodes(a))
+    {
+        for (int e = graph.offsets[u]; e < graph.offsets[u + 1]; ++e)
+        {
+            int v = graph.targets[e];
+            if (engine->stations.nodeStation[v] != b || (a == b && v < u))
+                continue;
+            int planned = graph.plannedWeights.empty() ? graph.weights[e] : graph.plannedWeights[e];
+            setEdgeWeight(u, v, weight == -1 ? planned : weight);
+            count++;
+        }
+    }
+    return count;
+}
+
+bool isDisruptionRecord(const string &line)
+{
+    string_view kind = string_view(line).substr(0, line.find('|'));
+    return kind == "CLOSE" || kind == "REOPEN" || kind == "WEIGHT" || kind == "SUSPEND" || kind == "RESUME";
+}
+
+// Applies one disruption record and echoes it back, or answers ERROR|<message>:
+//   CLOSE|<station>|<station>             close the segment between two neighbouring stations
+//   WEIGHT|<station>|<station>|<weight>   new weight for the segment, e.g. for a slow zone
+//   REOPEN|<station>|<station>            back to the weight the network was built with
+//   SUSPEND|<station>                     no changing lines at this interchange
+//   RESUME|<station>                      changing lines allowed again
+// A segment on several lines changes on all of them.
+string applyDisruption(const string &line)
+{
+    vector<string> fields = splitFields(line, '|');
+    const string &kind = fields[0];
+
+    bool segment = kind == "CLOSE" || kind == "WEIGHT" || kind == "REOPEN";
+    size_t expected = kind == "WEIGHT" ? 4 : segment ? 3
+                                                     : 2;
+    if (fields.size() != expected)
+        return "ERROR|" + kind + (segment ? " needs two stations" : " needs one station") + (kind == "WEIGHT" ? " and a weight" : "");
+
+    int a = findStation(fields[1]);
+    int b = segment ? findStation(fields[2]) : a;
+    if (a == -1 || b == -1)
+        return "ERROR|Invalid station name: " + (a == -1 ? fields[1] : fields[2]);
+    if (segment && a == b)
+        return "ERROR|" + kind + " needs two different stations";
+
+    int weight = -1;
+    if (kind == "CLOSE" || kind == "SUSPEND")
+        weight = CLOSED_EDGE;
+    else if (kind == "WEIGHT")
+    {
+        if (!parseInteger(fields[3], weight) || weight <= 0 || weight == CLOSED_EDGE)
+            return "ERROR|Weight must be a positive whole number, got '" + fields[3] + "'";
+    }
+
+    if (setStationEdges(a, b, weight) == 0)
+        return segment ? "ERROR|No segment between " + fields[1] + " and " + fields[2]
+                       : "ERROR|" + fields[1] + " is not an interchange";
+    return line;
+}
+
+// Applies the disruption records of a file in order (see applyDisruption).
+// Empty lines and lines starting with '#' are ignored.
+bool loadDisruptionFile(const string &fileName)
+{
+    ifstream in(fileName);
+    if (!in)
+    {
+        cerr << "Cannot open " << fileName << "\n";
+        return false;
+    }
+
+    string text;
+    int lineNo = 0;
+    while (getline(in, text))
+    {
+        ++lineNo;
+        if (!text.empty() && text.back() == '\r')
+            text.pop_back();
+        if (text.empty() || text[0] == '#')
+            continue;
+
+        string answer = isDisruptionRecord(text) ? applyDisruption(text) : "ERROR|unrecognised record '" + text + "'";
+        if (answer.compare(0, 6, "ERROR|") == 0)
+        {
+            cerr << fileName << ":" << lineNo << ": " << answer.substr(6) << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Passenger-flow assignment. Congestion follows the BPR curve of the US
+// Bureau of Public Roads: a segment carrying x trips a day against a
+// capacity c costs its length x (1 + BPR_ALPHA (x / c)^BPR_BETA).
+const double BPR_ALPHA = 0.15;
+const double BPR_BETA = 4;
+
+// Congested costs are integer edge weights in 1 / ASSIGNMENT_COST_SCALE KM
+const int ASSIGNMENT_COST_SCALE = 100;
+
+// Demand grouped by origin station, in CSR layout: the trips from
+// origins[i] are targets[offsets[i]] .. targets[offsets[i + 1] - 1]
+struct DemandByOrigin
+{
+    vector<int> origins;
+    vector<int> offsets;
+    vector<pair<int, double>> targets; // {destination, trips}
+};
+
+// One all-or-nothing pass: every trip takes its shortest route on the state
+// the calling thread routes on, and edgeTrips gets the trips on every edge.
+// Every origin gets one Dijkstra seeded with all of its nodes; the trips are
+// put on the nearest node of each destination and pushed up the shortest
+// path tree in reverse settle order, so an origin costs one search and one
+// pass over the nodes however many destinations it has. Origins are dealt
+// out to the threads in turn and every thread adds into its own edge array,
+// summed at the end. Returns the trips routed; unroutedTrips gets the others
+// and routeCost their summed route weights.
+double assignAllOrNothing(const DemandByOrigin &demand, int threads, vector<double> &edgeTrips,
+                          double &unroutedTrips, double &routeCost)
+{
+    const CsrGraph &graph = routing->graph;
+    int n = graph.size();
+    int parts = max(1, min<int>(threads, demand.origins.size()));
+
+    struct Accumulator
+    {
+        vector<double> edgeTrips;
+        double routed = 0;
+        double unrouted = 0;
+        double cost = 0;
+    };
+    vector<Accumulator> accumulators(parts);
+
+    parallelFor(parts, parts, [&](size_t part)
+                {
+        Accumulator &acc = accumulators[part];
+        acc.edgeTrips.assign(graph.targets.size(), 0.0);
+        vector<int> dist, prev, order;
+        vector<double> nodeTrips(n, 0.0);
+
+        for (size_t i = part; i < demand.origins.size(); i += parts)
+        {
+            int origin = demand.origins[i];
+            dijkstraToAny(stationNodes(origin), IdSpan(), dist, prev, &order);
+
+            for (int t = demand.offsets[i]; t < demand.offsets[i + 1]; ++t)
+            {
+                auto [destination, trips] = demand.targets[t];
+                int nearest = -1;
+                for (int node : stationNodes(destination))
+                    if (dist[node] != INT_MAX && (nearest == -1 || dist[node] < dist[nearest]))
+                        nearest = node;
+                if (nearest == -1)
+                {
+                    acc.unrouted += trips;
+                    continue;
+                }
+                nodeTrips[nearest] += trips;
+                acc.routed += trips;
+                acc.cost += trips * dist[nearest];
+            }
+
+            for (size_t k = order.size(); k-- > 0;)
+            {
+                int v = order[k];
+                double trips = nodeTrips[v];
+                if (trips == 0)
+                    continue;
+                nodeTrips[v] = 0;
+                if (prev[v] != -1)
+                {
+                    acc.edgeTrips[findEdge(graph, prev[v], v)] += trips;
+                    nodeTrips[prev[v]] += trips;
+                }
+            }
+        } });
+
+    edgeTrips.assign(graph.targets.size(), 0.0);
+    double routed = 0;
+    unroutedTrips = routeCost = 0;
+    for (const Accumulator &acc : accumulators)
+    {
+        for (size_t e = 0; e < edgeTrips.size(); ++e)
+            edgeTrips[e] += acc.edgeTrips[e];
+        routed += acc.routed;
+        unroutedTrips += acc.unrouted;
+        routeCost += acc.cost;
+    }
+    return routed;
+}
+
+// Loads of every segment and interchange for a day of demand. Trips within
+// one station are left out.
+//
+// Without a capacity this is one all-or-nothing pass. With one, the method
+// of successive averages approaches the equilibrium where no trip has a
+// faster route: round k prices every segment by BPR at the current loads,
+// routes all trips all-or-nothing on those prices and moves 1 / k of the
+// load onto the new routes. Interchanges keep their weight. The rounds run
+// on a private copy of the graph that the calling thread routes on
+// meanwhile, so queries of other threads are not affected.
+FlowAssignment assignFlows(const vector<OdDemand> &demand, int threads, double capacity, int iterations)
+{
+    TIME_OPERATION(Operation::AssignFlows);
+    FlowAssignment result;
+    const StationTable &stations = engine->stations;
+    const CsrGraph &graph = routing->graph;
+    int n = graph.size();
+
+    // Counting sort by origin, then one entry per destination
+    DemandByOrigin byOrigin;
+    vector<int> start(stations.stationCount() + 1, 0);
+    for (const OdDemand &od : demand)
+        if (od.source != od.destination)
+            start[od.source + 1]++;
+    for (int s = 0; s < stations.stationCount(); ++s)
+        start[s + 1] += start[s];
+    vector<pair<int, double>> sorted(start.back());
+    vector<int> fill(start.begin(), start.end() - 1);
+    for (const OdDemand &od : demand)
+        if (od.source != od.destination)
+            sorted[fill[od.source]++] = {od.destination, od.trips};
+
+    for (int s = 0; s < stations.stationCount(); ++s)
+    {
+        if (start[s] == start[s + 1])
+            continue;
+        sort(sorted.begin() + start[s], sorted.begin() + start[s + 1]);
+        byOrigin.origins.push_back(s);
+        byOrigin.offsets.push_back(byOrigin.targets.size());
+        for (int i = start[s]; i < start[s + 1]; ++i)
+        {
+            if (i > start[s] && sorted[i].first == sorted[i - 1].first)
+                byOrigin.targets.back().second += sorted[i].second;
+            else
+                byOrigin.targets.push_back(sorted[i]);
+        }
+    }
+    byOrigin.offsets.push_back(byOrigin.targets.size());
+
+    vector<double> edgeTrips, roundTrips;
+    double routeCost;
+    if (capacity <= 0)
+    {
+        result.assignedTrips = assignAllOrNothing(byOrigin, threads, edgeTrips, result.unroutedTrips, routeCost);
+        result.iterations = 1;
+    }
+    else
+    {
+        // Weights stay below this so no route can overflow
+        int maxWeight = INT_MAX / 2 / max(n, 1);
+        RoutingState congested;
+        congested.graph = graph;
+        const RoutingState *saved = routing;
+        routing = &congested;
+
+        for (int k = 1; k <= max(iterations, 1); ++k)
+        {
+            double totalCost = 0;
+            for (int u = 0; u < n; ++u)
+            {
+                for (int e = graph.offsets[u]; e < graph.offsets[u + 1]; ++e)
+                {
+                    int weight = graph.weights[e];
+                    if (weight == CLOSED_EDGE)
+                        continue;
+                    double cost = (double)weight * ASSIGNMENT_COST_SCALE;
+                    if (k > 1 && stations.nodeStation[u] != stations.nodeStation[graph.targets[e]])
+                        cost *= 1 + BPR_ALPHA * pow(edgeTrips[e] / capacity, BPR_BETA);
+                    congested.graph.weights[e] = max(1, (int)min<double>(llround(cost), maxWeight));
+                    if (k > 1)
+                        totalCost += edgeTrips[e] * congested.graph.weights[e];
+                }
+            }
+
+            result.assignedTrips = assignAllOrNothing(byOrigin, threads, roundTrips, result.unroutedTrips, routeCost);
+            if (k == 1)
+            {
+                edgeTrips = roundTrips;
+                continue;
+            }
+            for (size_t e = 0; e < edgeTrips.size(); ++e)
+                edgeTrips[e] += (roundTrips[e] - edgeTrips[e]) / k;
+            result.relativeGap = totalCost > 0 ? 1 - routeCost / totalCost : 0;
+        }
+        result.iterations = max(iterations, 1);
+        routing = saved;
+    }
+
+    vector<double> stationTrips(stations.stationCount(), 0.0);
+    for (int u = 0; u < n; ++u)
+    {
+        for (int e = graph.offsets[u]; e < graph.offsets[u + 1]; ++e)
+        {
+            if (edgeTrips[e] <= 0)
+                continue;
+            int v = graph.targets[e];
+            if (stations.nodeStation[u] == stations.nodeStation[v])
+                stationTrips[stations.nodeStation[u]] += edgeTrips[e];
+            else
+                result.segments.push_back({u, v, edgeTrips[e]});
+        }
+    }
+    for (int s = 0; s < stations.stationCount(); ++s)
+        if (stationTrips[s] > 0)
+            result.interchanges.push_back({s, stationTrips[s]});
+    return result;
+}
+
+// Timetable layer over the line definitions. Every line runs trains from
+// both terminals at a fixed headway during service hours. A train takes the
+// segment run time between stations (KM x secondsPerKm unless a segment is
+// overridden) and dwells at every intermediate stop; changing lines at an
+// interchange takes the station's transfer time. Times are seconds after
+// midnight.
+struct TimetableSpec
+{
+    int firstDeparture = 6 * 3600;
+    int lastDeparture = 23 * 3600;
+    int headwaySeconds = 300;
+    int secondsPerKm = 72; // 50 km/h, the speed used for travel time estimates
+    int dwellSeconds = 30;
+    int transferSeconds = 180;
+    map<char, int> lineHeadway;               // line prefix -> headway
+    map<pair<int, int>, int> segmentSeconds;  // (station, station), either direction -> run time
+    map<int, int> stationTransfer;            // station -> transfer time
+};
+
+// One train hop between neighbouring nodes of a line
+struct Connection
+{
+    int from;
+    int to;
+    int departure;
+    int arrival;
+    int trip;
+};
+
+// All connections of a service day sorted by departure, so both queries
+// below are single linear passes over one contiguous array
+struct Timetable
+{
+    vector<Connection> connections;
+    vector<char> tripLine; // line prefix of every trip
+
+    // Transfers between nodes of the same station, in CSR layout
+    vector<int> footOffsets;
+    vector<int> footTargets;
+    vector<int> footSeconds;
+
+    bool empty() const { return connections.empty(); }
+    int tripCount() const { return tripLine.size(); }
+};
+
+// Forgets all stations and edges so a different network can be loaded,
+// together with the timetable and OD matrix, which hold node and station
+// ids of the old one
+void clearNetwork()
+{
+    engine->stations = StationTable();
+    initializeGraph();
+    *engine->timetable = Timetable();
+    *engine->odMatrix = OdMatrix();
+}
+
+string formatClock(int seconds)
+{
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%02d:%02d:%02d", seconds / 3600, seconds / 60 % 60, seconds % 60);
+    return buf;
+}
+
+// Weight of the edge from -> to as built, before any slow zone, or -1 if
+// there is no such edge or a disruption has closed it
+int plannedEdgeWeight(int from, int to)
+{
+    const CsrGraph &graph = engine->liveRouting.graph;
+    int e = findEdge(graph, from, to);
+    if (e == -1 || graph.weights[e] == CLOSED_EDGE)
+        return -1;
+    int planned = graph.plannedWeights.empty() ? graph.weights[e] : graph.plannedWeights[e];
+    return planned == CLOSED_EDGE ? -1 : planned;
+}
+
+// Builds the trips of every line of the current graph. A line is a run of
+// consecutive nodes with the same prefix joined by edges, as addLine()
+// creates them; a closed segment ends the run, so trains turn back there.
+// Run times come from the planned weights and a segment never takes more
+// than a day.
+void buildTimetable(const TimetableSpec &spec)
+{
+    const CsrGraph &graph = engine->liveRouting.graph;
+    Timetable tt;
+    int n = graph.size();
+
+    for (int start = 0, end; start < n; start = end)
+    {
+        char line = engine->stations.nodeLine[start];
+        for (end = start + 1; end < n && engine->stations.nodeLine[end] == line && plannedEdgeWeight(end - 1, end) > 0; ++end)
+            ;
+        if (end - start < 2)
+            continue;
+
+        vector<int> runSeconds;
+        for (int u = start; u + 1 < end; ++u)
+        {
+            int a = engine->stations.nodeStation[u], b = engine->stations.nodeStation[u + 1];
+            auto it = spec.segmentSeconds.find({min(a, b), max(a, b)});
+            long long seconds = (long long)plannedEdgeWeight(u, u + 1) * spec.secondsPerKm;
+            runSeconds.push_back(it != spec.segmentSeconds.end() ? it->second : (int)clamp(seconds, 1ll, 24 * 3600ll));
+        }
+
+        auto headway = spec.lineHeadway.find(line);
+        int every = max(1, headway != spec.lineHeadway.end() ? headway->second : spec.headwaySeconds);
+        for (int direction = 0; direction < 2; ++direction)
+        {
+            for (int t = spec.firstDeparture; t <= spec.lastDeparture; t += every)
+            {
+                int trip = tt.tripCount();
+                tt.tripLine.push_back(line);
+                int time = t;
+                for (int s = 0; s + 1 < end - start; ++s)
+                {
+                    int seg = direction == 0 ? s : end - start - 2 - s;
+                    int from = direction == 0 ? start + seg : start + seg + 1;
+                    int to = direction == 0 ? start + seg + 1 : start + seg;
+                    tt.connections.push_back({from, to, time, time + runSeconds[seg], trip});
+                    time += runSeconds[seg] + spec.dwellSeconds;
+                }
+            }
+        }
+    }
+
+    stable_sort(tt.connections.begin(), tt.connections.end(), [](const Connection &a, const Connection &b)
+                { return a.departure < b.departure; });
+
+    tt.footOffsets.assign(n + 1, 0);
+    for (int u = 0; u < n; ++u)
+    {
+        int station = engine->stations.nodeStation[u];
+        auto transfer = spec.stationTransfer.find(station);
+        for (int e = graph.offsets[u]; e < graph.offsets[u + 1]; ++e)
+        {
+            int v = graph.targets[e];
+            if (engine->stations.nodeStation[v] != station)
+                continue;
+            tt.footTargets.push_back(v);
+            tt.footSeconds.push_back(transfer != spec.stationTransfer.end() ? transfer->second : spec.transferSeconds);
+        }
+        tt.footOffsets[u + 1] = tt.footTargets.size();
+    }
+
+    *engine->timetable = move(tt);
+}
+
+// Reads timetable settings, one record per line (times as HH:MM):
+//   SERVICE|<first>|<last>               first and last departures from the terminals
+//   HEADWAY|<minutes>[|<line prefix>]    for all lines, or for one line
+//   RUNTIME|<seconds per KM>
+//   DWELL|<seconds>
+//   SEGMENT|<station>|<station>|<seconds>  run time of one segment, both directions
+//   TRANSFER|<seconds>[|<station>]       change time at all interchanges, or at one
+// Empty lines and lines starting with '#' are ignored. Station names must
+// exist in the loaded network.
+bool loadTimetableFile(const string &fileName, TimetableSpec &spec)
+{
+    ifstream in(fileName);
+    if (!in)
+    {
+        cerr << "Cannot open " << fileName << "\n";
+        return false;
+    }
+
+    string text;
+    int lineNo = 0;
+    auto fail = [&](const string &message)
+    {
+        cerr << fileName << ":" << lineNo << ": " << message << "\n";
+        return false;
+    };
+
+    while (getline(in, text))
+    {
+        ++lineNo;
+        if (!text.empty() && text.back() == '\r')
+            text.pop_back();
+        if (text.empty() || text[0] == '#')
+            continue;
+
+        vector<string> fields = splitFields(text, '|');
+        const string &kind = fields[0];
+        int number = fields.size() > 1 ? atoi(fields[1].c_str()) : 0;
+        if (kind == "SERVICE" && fields.size() == 3)
+        {
+            int first = parseClock(fields[1]), last = parseClock(fields[2]);
+            if (first == -1 || last == -1 || last < first)
+                return fail("bad service hours '" + text + "'");
+            spec.firstDeparture = first * 60;
+            spec.lastDeparture = last * 60;
+        }
+        else if (kind == "HEADWAY" && (fields.size() == 2 || (fields.size() == 3 && fields[2].size() == 1)) && number > 0)
+        {
+            if (fields.size() == 3)
+                spec.lineHeadway[fields[2][0]] = number * 60;
+            else
+                spec.headwaySeconds = number * 60;
+        }
+        else if (kind == "RUNTIME" && fields.size() == 2 && number > 0)
+            spec.secondsPerKm = number;
+        else if (kind == "DWELL" && fields.size() == 2 && number >= 0)
+            spec.dwellSeconds = number;
+        else if (kind == "SEGMENT" && fields.size() == 4)
+        {
+            int a = findStation(fields[1]), b = findStation(fields[2]);
+            int seconds = atoi(fields[3].c_str());
+            if (a == -1 || b == -1 || seconds <= 0)
+                return fail("bad segment '" + text + "'");
+            spec.segmentSeconds[{min(a, b), max(a, b)}] = seconds;
+        }
+        else if (kind == "TRANSFER" && (fields.size() == 2 || fields.size() == 3) && number >= 0)
+        {
+            if (fields.size() == 2)
+            {
+                spec.transferSeconds = number;
+                continue;
+            }
+            int station = findStation(fields[2]);
+            if (station == -1)
+                return fail("unknown station '" + fields[2] + "'");
+            spec.stationTransfer[station] = number;
+        }
+        else
+            return fail("unrecognised record '" + text + "'");
+    }
+    return true;
+}
+
+// Earliest arrival at destStation when leaving srcStation at departure, by
+// the Connection Scan Algorithm: one pass over the connections departing
+// from then on, stopping as soon as no later connection can arrive earlier.
+Journey earliestArrival(int srcStation, int destStation, int departure)
+{
+    const vector<Connection> &conns = engine->timetable->connections;
+    int n = engine->timetable->footOffsets.size() - 1;
+
+    // Reused by every query on this thread
+    thread_local vector<int> arrival, reachedBy, walkedFrom, boardedAt;
+    arrival.assign(n, INT_MAX);
+    reachedBy.assign(n, -1);  // connection that arrived, or -1
+    walkedFrom.assign(n, -1); // node a transfer started from, or -1
+    boardedAt.assign(engine->timetable->tripCount(), -1);
+
+    Journey journey;
+    for (int node : stationNodes(srcStation))
+        arrival[node] = departure;
+    if (srcStation == destStation)
+    {
+        journey.arrival = departure;
+        return journey;
+    }
+
+    auto first = lower_bound(conns.begin(), conns.end(), departure, [](const Connection &c, int t)
+                             { return c.departure < t; });
+    for (size_t i = first - conns.begin(); i < conns.size(); ++i)
+    {
+        const Connection &c = conns[i];
+        if (c.departure >= journey.arrival)
+            break;
+
+        if (boardedAt[c.trip] == -1)
+        {
+            if (arrival[c.from] > c.departure)
+                continue;
+            boardedAt[c.trip] = i;
+        }
+        if (c.arrival >= arrival[c.to])
+            continue;
+
+        arrival[c.to] = c.arrival;
+        reachedBy[c.to] = i;
+        walkedFrom[c.to] = -1;
+        if (engine->stations.nodeStation[c.to] == destStation)
+            journey.arrival = min(journey.arrival, c.arrival);
+
+        for (int f = engine->timetable->footOffsets[c.to]; f < engine->timetable->footOffsets[c.to + 1]; ++f)
+        {
+            int v = engine->timetable->footTargets[f];
+            if (c.arrival + engine->timetable->footSeconds[f] < arrival[v])
+            {
+                arrival[v] = c.arrival + engine->timetable->footSeconds[f];
+                reachedBy[v] = -1;
+                walkedFrom[v] = c.to;
+            }
+        }
+    }
+
+    if (journey.arrival == INT_MAX)
+        return journey;
+
+    // Walk back from the destination node reached first, one leg per train
+    int node = -1;
+    for (int target : stationNodes(destStation))
+        if (arrival[target] == journey.arrival && reachedBy[target] != -1)
+            node = target;
+    while (node != -1)
+    {
+        if (walkedFrom[node] != -1)
+        {
+            node = walkedFrom[node];
+            continue;
+        }
+        if (reachedBy[node] == -1)
+            break;
+        const Connection &exit = conns[reachedBy[node]];
+        const Connection &board = conns[boardedAt[exit.trip]];
+        journey.legs.push_back({exit.trip, board.from, exit.to, board.departure, exit.arrival});
+        node = board.from;
+    }
+    reverse(journey.legs.begin(), journey.legs.end());
+    return journey;
+}
+
+// All journeys from srcStation to destStation departing between from and to
+// that are not beaten by a later departure arriving no later, in order of
+// departure. One backward Connection Scan over the connections departing at
+// or after from: every node keeps its own profile, every trip the earliest
+// arrival when staying on board.
+vector<ProfileEntry> profileQuery(int srcStation, int destStation, int from, int to)
+{
+    const vector<Connection> &conns = engine->timetable->connections;
+    int n = engine->timetable->footOffsets.size() - 1;
+
+    // Per node, entries with falling departure and strictly falling arrival
+    thread_local vector<vector<ProfileEntry>> profile;
+    thread_local vector<int> tripArrival;
+    profile.resize(n);
+    for (auto &entries : profile)
+        entries.clear();
+    tripArrival.assign(engine->timetable->tripCount(), INT_MAX);
+
+    // Earliest arrival leaving node at or after time t
+    auto evaluate = [&](int node, int t)
+    {
+        const vector<ProfileEntry> &entries = profile[node];
+        auto it = partition_point(entries.begin(), entries.end(), [&](const ProfileEntry &e)
+                                  { return e.departure >= t; });
+        return it == entries.begin() ? INT_MAX : prev(it)->arrival;
+    };
+
+    auto first = lower_bound(conns.begin(), conns.end(), from, [](const Connection &c, int t)
+                             { return c.departure < t; });
+    for (size_t i = conns.size(); i-- > (size_t)(first - conns.begin());)
+    {
+        const Connection &c = conns[i];
+        int best = engine->stations.nodeStation[c.to] == destStation ? c.arrival : INT_MAX;
+        best = min(best, tripArrival[c.trip]);
+        best = min(best, evaluate(c.to, c.arrival));
+        for (int f = engine->timetable->footOffsets[c.to]; f < engine->timetable->footOffsets[c.to + 1]; ++f)
+            best = min(best, evaluate(engine->timetable->footTargets[f], c.arrival + engine->timetable->footSeconds[f]));
+        if (best == INT_MAX)
+            continue;
+
+        tripArrival[c.trip] = best;
+        vector<ProfileEntry> &entries = profile[c.from];
+        if (entries.empty() || best < entries.back().arrival)
+        {
+            if (!entries.empty() && entries.back().departure == c.departure)
+                entries.back().arrival = best;
+            else
+                entries.push_back({c.departure, best});
+        }
+    }
+
+    // Merge the profiles of the source nodes, keeping the Pareto front. Later
+    // departures (even after the window) can beat earlier ones, so the window
+    // end is applied last.
+    vector<ProfileEntry> all;
+    for (int node : stationNodes(srcStation))
+        all.insert(all.end(), profile[node].begin(), profile[node].end());
+    sort(all.begin(), all.end(), [](const ProfileEntry &a, const ProfileEntry &b)
+         { return a.departure != b.departure ? a.departure > b.departure : a.arrival < b.arrival; });
+
+    vector<ProfileEntry> result;
+    for (const ProfileEntry &e : all)
+        if (result.empty() || e.arrival < result.back().arrival)
+            result.push_back(e);
+    reverse(result.begin(), result.end());
+    while (!result.empty() && result.back().departure > to)
+        result.pop_back();
+    return result;
+}
+
+// Collects output in a large buffer and hands it to stdio in few big writes
+class BufferedWriter
+{
+public:
+    explicit BufferedWriter(FILE *out, size_t capacity = 1 << 16)
+        : out(out), capacity(capacity)
+    {
+        buffer.reserve(capacity);
+    }
+
+    ~BufferedWriter() { flush(); }
+
+    void write(string_view text)
+    {
+        if (buffer.size() + text.size() > capacity)
+            flush();
+        buffer.append(text);
+    }
+
+    void put(char c)
+    {
+        if (buffer.size() == capacity)
+            flush();
+        buffer.push_back(c);
+    }
+
+    void flush()
+    {
+        if (!buffer.empty())
+            fwrite(buffer.data(), 1, buffer.size(), out);
+        buffer.clear();
+    }
+
+private:
+    FILE *out;
+    size_t capacity;
+    string buffer;
+};
+
+// Fixed pool of worker threads. start() hands out the indexes [0, count)
+// of a job to the workers, wait() lets the calling thread help and returns
+// once every index has been processed. The workers run a job on the
+// engine and routing state of the thread that started it.
+class WorkerPool
+{
+public:
+    explicit WorkerPool(int extraThreads)
+    {
+        for (int i = 0; i < extraThreads; ++i)
+            workers.emplace_back([this]
+                                 { workerLoop(); });
+    }
+
+    ~WorkerPool()
+    {
+        {
+            lock_guard<mutex> lock(m);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for (thread &t : workers)
+            t.join();
+    }
+
+    void start(size_t count, function<void(size_t)> fn)
+    {
+        {
+            lock_guard<mutex> lock(m);
+            job = move(fn);
+            jobEngine = engine;
+            jobRouting = routing;
+            jobSize = count;
+            nextIndex = 0;
+            pending = workers.size();
+            generation++;
+        }
+        wakeUp.notify_all();
+    }
+
+    void wait()
+    {
+        drain();
+        unique_lock<mutex> lock(m);
+        allDone.wait(lock, [this]
+                     { return pending == 0; });
+    }
+
+    int size() const { return workers.size() + 1; }
+
+private:
+    void drain()
+    {
+        for (size_t i = nextIndex++; i < jobSize; i = nextIndex++)
+            job(i);
+    }
+
+    void workerLoop()
+    {
+        long long seen = 0;
+        while (true)
+        {
+            {
+                unique_lock<mutex> lock(m);
+                wakeUp.wait(lock, [&]
+                            { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+                engine = jobEngine;
+                routing = jobRouting;
+            }
+
+            drain();
+
+            lock_guard<mutex> lock(m);
+            if (--pending == 0)
+                allDone.notify_all();
+        }
+    }
+
+    vector<thread> workers;
+    mutex m;
+    condition_variable wakeUp, allDone;
+    function<void(size_t)> job;
+    EngineState *jobEngine = nullptr;
+    const RoutingState *jobRouting = nullptr;
+    size_t jobSize = 0;
+    atomic<size_t> nextIndex{0};
+    size_t pending = 0;
+    long long generation = 0;
+    bool stopping = false;
+};
+
+// Names of the given ids joined with " -> "; nameOf is nodeName or stationName
+string joinPath(IdSpan path, string_view (*nameOf)(int))
+{
+    string out;
+    for (size_t i = 0; i < path.size(); ++i)
+    {
+        out += nameOf(path[i]);
+        if (i < path.size() - 1)
+            out += " -> ";
+    }
+    return out;
+}
+
+string formatPrice(double price)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%g", price);
+    return buf;
+}
+
+// Answers one batch query line. Formats (station names must match exactly):
+//   PATH|<source>|<destination>     ->  PATH|<distance>|<station> -> ... -> <station>
+//   TICKET|<source>|<destination>   ->  TICKET|<source>|<destination>|<distance>|<price>
+//   ROUTES|<source>|<destination>[|<k>]
+//                                   ->  ROUTES|<distance>|<station> -> ...|<distance>|<station> -> ...
+//                                       (up to k alternatives, DEFAULT_ALTERNATIVE_COUNT if not given)
+//   PARETO|<source>|<destination>   ->  PARETO|<distance>|<changes>|<station> -> ...|<distance>|<changes>|...
+//                                       (every route not beaten on both distance and line changes)
+//   OD|<source>|<destination>       ->  OD|<distance>|<price>   (from the matrix loaded with --od-matrix)
+//   WITHIN|<station>|<radius>       ->  WITHIN|<station>|<distance>|<station>|<distance>|...  (by station id)
+//   MEET|<station>|<station>|...    ->  MEET|<best meeting station>           (shortest longest journey)
+//   MEETSUM|<station>|<station>|... ->  MEETSUM|<best meeting station>        (shortest total distance)
+//   TRIP|<station>|<station>|...    ->  TRIP|<distance>|<visiting order>   (open path from the first station)
+//   TOUR|<station>|<station>|...    ->  TOUR|<distance>|<visiting order>   (back to the first station)
+//   ARRIVE|<source>|<destination>|<HH:MM>
+//                                   ->  ARRIVE|<arrival>|<departure> <station> -> <arrival> <station> (<line>), ...
+//   PROFILE|<source>|<destination>|<HH:MM>|<HH:MM>
+//                                   ->  PROFILE|<departure> -> <arrival>, ...  (every useful departure in the window)
+//   SEARCH|<part of a name>         ->  SEARCH|<station>|<station>|...  (autocomplete, at most SEARCH_RESULT_LIMIT)
+//   FUZZY|<name with typos>[|<max errors>]
+//                                   ->  FUZZY|<station>|<errors>|<station>|<errors>|...  (at most SEARCH_RESULT_LIMIT)
+//   METRICS[|json]                  ->  METRICS|<metricsJson() line>
+//   METRICS|prometheus              ->  metricsPrometheus(), the only answer spanning several lines
+// ARRIVE and PROFILE need a timetable, see --timetable.
+// Disruption records (CLOSE, WEIGHT, ...) are applied by runBatch, see applyDisruption.
+// Problems are answered with ERROR|<message>, so every query gets exactly one line.
+string answerBatchQuery(const string &line)
+{
+    vector<string> fields = splitFields(line, '|');
+    const string &kind = fields[0];
+
+    if (kind == "METRICS")
+    {
+#if METROGO_METRICS
+        if (fields.size() == 1 || (fields.size() == 2 && fields[1] == "json"))
+            return "METRICS|" + metricsJson();
+        if (fields.size() == 2 && fields[1] == "prometheus")
+            return metricsPrometheus();
+        return "ERROR|METRICS takes json or prometheus";
+#else
+        return "ERROR|Built without metrics (METROGO_METRICS=0)";
+#endif
+    }
+
+    if (kind == "SEARCH")
+    {
+        if (fields.size() != 2)
+            return "ERROR|SEARCH needs part of a station name";
+        string out = "SEARCH";
+        for (int station : searchStations(fields[1], SEARCH_RESULT_LIMIT))
+            out += "|" + string(stationName(station));
+        return out;
+    }
+
+    if (kind == "FUZZY")
+    {
+        if (fields.size() != 2 && fields.size() != 3)
+            return "ERROR|FUZZY needs part of a station name and optionally an error bound";
+        int maxErrors = fields.size() == 3 ? atoi(fields[2].c_str()) : -1;
+        if (fields.size() == 3 && (fields[2].empty() || maxErrors < 0))
+            return "ERROR|Bad error bound " + fields[2];
+        string out = "FUZZY";
+        for (const FuzzyMatch &match : fuzzySearchStations(fields[1], SEARCH_RESULT_LIMIT, maxErrors))
+            out += "|" + string(stationName(match.station)) + "|" + to_string(match.errors);
+        return out;
+    }
+
+    // Timetable queries end with times instead of stations
+    bool timed = kind == "ARRIVE" || kind == "PROFILE";
+    size_t stationFields = timed || kind == "ROUTES" ? min<size_t>(fields.size(), 3)
+                           : kind == "WITHIN"            ? min<size_t>(fields.size(), 2)
+                                                         : fields.size();
+
+    vector<int> ids;
+    for (size_t i = 1; i < stationFields; ++i)
+    {
+        ids.push_back(findStation(fields[i]));
+        if (ids.back() == -1)
+            return "ERROR|Invalid station name: " + fields[i];
+    }
+
+    if (kind == "OD")
+    {
+        if (fields.size() != 3)
+            return "ERROR|OD needs a source and a destination station";
+        if (engine->odMatrix->empty())
+            return "ERROR|No OD matrix loaded";
+        if (engine->odMatrix->distance(ids[0], ids[1]) == OD_UNREACHABLE)
+            return "ERROR|No path found between stations";
+        return "OD|" + to_string(engine->odMatrix->distance(ids[0], ids[1])) + "|" + formatPrice(engine->odMatrix->farePaise(ids[0], ids[1]) / 100.0);
+    }
+
+    if (kind == "PATH" || kind == "TICKET")
+    {
+        if (fields.size() != 3)
+            return "ERROR|" + kind + " needs a source and a destination station";
+
+        RouteResult route = shortestRoute(ids[0], ids[1]);
+        if (route.path.empty())
+            return "ERROR|No path found between stations";
+
+        if (kind == "PATH")
+            return "PATH|" + to_string(route.distance) + "|" + joinPath(route.path, nodeName);
+        return "TICKET|" + fields[1] + "|" + fields[2] + "|" + to_string(route.distance) + "|" + formatPrice(route.farePaise / 100.0);
+    }
+
+    if (kind == "ROUTES")
+    {
+        if (fields.size() != 3 && fields.size() != 4)
+            return "ERROR|ROUTES needs a source, a destination and optionally a count";
+        int k = fields.size() == 4 ? atoi(fields[3].c_str()) : DEFAULT_ALTERNATIVE_COUNT;
+        if (k <= 0)
+            return "ERROR|Bad route count " + fields[3];
+
+        vector<AlternativeRoute> routes = alternativeRoutes(ids[0], ids[1], k);
+        if (routes.empty())
+            return "ERROR|No path found between stations";
+        string out = "ROUTES";
+        for (const AlternativeRoute &route : routes)
+            out += "|" + to_string(route.distance) + "|" + joinPath(route.path, nodeName);
+        return out;
+    }
+
+    if (kind == "WITHIN")
+    {
+        if (fields.size() != 3)
+            return "ERROR|WITHIN needs a station and a radius";
+        int radius = atoi(fields[2].c_str());
+        if (fields[2].empty() || radius < 0)
+            return "ERROR|Bad radius " + fields[2];
+
+        string out = "WITHIN";
+        for (const StationDistance &reached : reachableStations(ids[0], radius))
+            out += "|" + string(stationName(reached.station)) + "|" + to_string(reached.distance);
+        return out;
+    }
+
+    if (kind == "PARETO")
+    {
+        if (fields.size() != 3)
+            return "ERROR|PARETO needs a source and a destination station";
+
+        vector<ParetoRoute> routes = paretoRoutes(ids[0], ids[1]);
+        if (routes.empty())
+            return "ERROR|No path found between stations";
+        string out = "PARETO";
+        for (const ParetoRoute &route : routes)
+            out += "|" + to_string(route.distance) + "|" + to_string(route.transfers) + "|" + joinPath(route.path, nodeName);
+        return out;
+    }
+
+    if (kind == "MEET" || kind == "MEETSUM")
+    {
+        if (fields.size() < 2)
+            return "ERROR|" + kind + " needs at least one station";
+
+        vector<MeetingPoint> best = findMeetingPoints(ids,
+                                                      kind == "MEET" ? MeetingObjective::MinMax : MeetingObjective::MinSum, 1);
+        if (best.empty())
+            return "ERROR|No valid meeting point found";
+        return kind + "|" + string(stationName(best[0].station));
+    }
+
+    if (kind == "TRIP" || kind == "TOUR")
+    {
+        if (fields.size() < 2)
+            return "ERROR|" + kind + " needs at least one station";
+
+        bool returnToStart = kind == "TOUR";
+        vector<vector<int>> d = stationDistanceMatrix(ids);
+
+        TripPlan plan = (int)ids.size() <= MAX_EXACT_TRIP_STOPS
+                            ? tsp(d, returnToStart)
+                            : heuristicTsp(d, returnToStart, HEURISTIC_TRIP_BUDGET_MS, 1).plan;
+        if (plan.order.empty())
+            return "ERROR|No path found between stations";
+
+        vector<int> order;
+        for (int i : plan.order)
+            order.push_back(ids[i]);
+        if (returnToStart)
+            order.push_back(ids[0]);
+        return kind + "|" + to_string(plan.total) + "|" + joinPath(order, stationName);
+    }
+
+    if (timed)
+    {
+        if (fields.size() != (kind == "ARRIVE" ? 4u : 5u))
+            return "ERROR|" + kind + (kind == "ARRIVE" ? " needs a source, a destination and a time"
+                                                       : " needs a source, a destination and two times");
+        if (engine->timetable->empty())
+            return "ERROR|No timetable loaded";
+
+        int from = parseClock(fields[3]);
+        int to = kind == "PROFILE" ? parseClock(fields[4]) : from;
+        if (from == -1 || to == -1)
+            return "ERROR|Bad time, expected HH:MM";
+
+        if (kind == "ARRIVE")
+        {
+            Journey journey = earliestArrival(ids[0], ids[1], from * 60);
+            if (journey.arrival == INT_MAX)
+                return "ERROR|No connection after " + fields[3];
+            string out = "ARRIVE|" + formatClock(journey.arrival) + "|";
+            for (size_t i = 0; i < journey.legs.size(); ++i)
+            {
+                const JourneyLeg &leg = journey.legs[i];
+                if (i > 0)
+                    out += ", ";
+                out += formatClock(leg.departure) + " " + string(nodeName(leg.fromNode)) + " -> " +
+                       formatClock(leg.arrival) + " " + string(nodeName(leg.toNode)) + " (" + engine->timetable->tripLine[leg.trip] + ")";
+            }
+            return out;
+        }
+
+        vector<ProfileEntry> entries = profileQuery(ids[0], ids[1], from * 60, to * 60);
+        if (entries.empty())
+            return "ERROR|No connection between " + fields[3] + " and " + fields[4];
+        string out = "PROFILE|";
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+            if (i > 0)
+                out += ", ";
+            out += formatClock(entries[i].departure) + " -> " + formatClock(entries[i].arrival);
+        }
+        return out;
+    }
+
+    return "ERROR|Unknown query type: " + kind;
+}
+
+// Number of query lines handed to the workers at a time
+const size_t BATCH_BLOCK_SIZE = 4096;
+
+// Non-interactive mode: reads queries (see answerBatchQuery) line by line,
+// answers them on a worker pool and writes the answers to out in input
+// order. Empty lines and lines starting with '#' are skipped. While the
+// workers answer one block, the previous block is written out.
+// A disruption record (see applyDisruption) ends its block and is applied
+// once the queries before it are answered, so they never see it and every
+// query after it does.
+// A throughput and latency summary goes to stderr.
+void runBatch(istream &in, FILE *out, int threads)
+{
+    WorkerPool pool(max(threads, 1) - 1);
+    BufferedWriter writer(out);
+
+    vector<string> lines[2], answers[2];
+    vector<long long> latencyNs[2];
+    vector<long long> allLatencies;
+
+    auto begin = chrono::steady_clock::now();
+    int cur = 0;
+    bool havePrevious = false;
+
+    while (true)
+    {
+        lines[cur].clear();
+        string line;
+        bool disruption = false;
+        while (!disruption && lines[cur].size() < BATCH_BLOCK_SIZE && getline(in, line))
+        {
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            if (line.empty() || line[0] == '#')
+                continue;
+            lines[cur].push_back(line);
+            disruption = isDisruptionRecord(line);
+        }
+
+        size_t count = lines[cur].size();
+        answers[cur].assign(count, string());
+        latencyNs[cur].assign(count, 0);
+
+        pool.start(count - disruption, [&, cur](size_t i)
+                   {
+            auto t0 = chrono::steady_clock::now();
+            answers[cur][i] = answerBatchQuery(lines[cur][i]);
+            latencyNs[cur][i] = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - t0).count(); });
+
+        if (havePrevious)
+        {
+            int prev = cur ^ 1;
+            for (string &answer : answers[prev])
+            {
+                answer += '\n';
+                writer.write(answer);
+            }
+            allLatencies.insert(allLatencies.end(), latencyNs[prev].begin(), latencyNs[prev].end());
+        }
+
+        pool.wait();
+
+        if (disruption)
+        {
+            auto t0 = chrono::steady_clock::now();
+            answers[cur].back() = applyDisruption(lines[cur].back());
+            latencyNs[cur].back() = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - t0).count();
+        }
+
+        if (count == 0)
+            break;
+        havePrevious = true;
+        cur ^= 1;
+    }
+    writer.flush();
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    size_t total = allLatencies.size();
+    auto percentile = [&](double q) -> double
+    {
+        if (total == 0)
+            return 0;
+        size_t k = min(total - 1, (size_t)(q * total));
+        nth_element(allLatencies.begin(), allLatencies.begin() + k, allLatencies.end());
+        return allLatencies[k] / 1000.0;
+    };
+    double p50 = percentile(0.50);
+    double p99 = percentile(0.99);
+
+    fprintf(stderr, "Batch: %zu queries in %.3f s on %d threads, %.0f queries/s, latency p50 %.1f us, p99 %.1f us\n",
+            total, seconds, pool.size(), seconds > 0 ? total / seconds : 0.0, p50, p99);
+    printRouteCacheStats();
+}
+
+// Routes and prices a ticket in place
+void issueTicket(Ticket &ticket, uint32_t serial, int source, int destination, int minuteOfDay)
+{
+    TIME_OPERATION(Operation::IssueTicket);
+    ticket.serial = serial;
+    ticket.source = source;
+    ticket.destination = destination;
+    ticket.minuteOfDay = minuteOfDay;
+    ticket.error = nullptr;
+    ticket.path.clear();
+
+    RouteResult route = shortestRoute(source, destination);
+    if (route.path.empty())
+    {
+        ticket.error = "No path found between stations";
+        return;
+    }
+    ticket.distance = route.distance;
+    ticket.farePaise = minuteOfDay == -1 ? route.farePaise : farePaise(engine->fareRules, route.distance, minuteOfDay);
+    ticket.path.assign(route.path.begin(), route.path.end());
+}
+
+// Parses "<source>|<destination>[|<HH:MM>]" and issues the ticket
+void issueTicket(Ticket &ticket, uint32_t serial, string_view request)
+{
+    size_t first = request.find('|');
+    size_t second = first == string_view::npos ? first : request.find('|', first + 1);
+    int source = findStation(request.substr(0, first));
+    int destination = first == string_view::npos ? -1 : findStation(request.substr(first + 1, second == string_view::npos ? string_view::npos : second - first - 1));
+    int minuteOfDay = second == string_view::npos ? -1 : parseClock(request.substr(second + 1));
+
+    const char *error = nullptr;
+    if (source == -1 || destination == -1)
+        error = "Invalid station name";
+    else if (second != string_view::npos && minuteOfDay == -1)
+        error = "Bad travel time, expected HH:MM";
+    if (!error)
+    {
+        issueTicket(ticket, serial, source, destination, minuteOfDay);
+        return;
+    }
+
+    ticket.serial = serial;
+    ticket.source = source;
+    ticket.destination = destination;
+    ticket.minuteOfDay = -1;
+    ticket.error = error;
+    ticket.path.clear();
+}
+
+// Fixed-width binary ticket, written in host byte order. Tickets that could
+// not be issued have distance -1.
+struct TicketRecord
+{
+    uint32_t serial;
+    int32_t source;
+    int32_t destination;
+    int32_t distance;
+    int32_t farePaise;
+    int16_t minuteOfDay;
+    uint16_t stops;
+};
+
+void writeJsonString(BufferedWriter &writer, string_view text)
+{
+    writer.put('"');
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            writer.put('\\');
+        if ((unsigned char)c < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            writer.write(escaped);
+            continue;
+        }
+        writer.put(c);
+    }
+    writer.put('"');
+}
+
+void renderTicket(const Ticket &ticket, TicketFormat format, BufferedWriter &writer)
+{
+    char buf[64];
+    if (format == TicketFormat::Binary)
+    {
+        TicketRecord record = {ticket.serial, ticket.source, ticket.destination,
+                               ticket.error ? -1 : ticket.distance, ticket.error ? 0 : ticket.farePaise,
+                               (int16_t)ticket.minuteOfDay, (uint16_t)min<size_t>(ticket.path.size(), UINT16_MAX)};
+        writer.write(string_view(reinterpret_cast<const char *>(&record), sizeof(record)));
+        return;
+    }
+
+    if (format == TicketFormat::Text)
+    {
+        snprintf(buf, sizeof(buf), "%u|", ticket.serial);
+        writer.write(buf);
+        if (ticket.error)
+        {
+            writer.write("ERROR|");
+            writer.write(ticket.error);
+            writer.put('\n');
+            return;
+        }
+        writer.write(stationName(ticket.source));
+        writer.put('|');
+        writer.write(stationName(ticket.destination));
+        snprintf(buf, sizeof(buf), "|%d|%s", ticket.distance, formatPrice(ticket.farePaise / 100.0).c_str());
+        writer.write(buf);
+        if (ticket.minuteOfDay >= 0)
+        {
+            snprintf(buf, sizeof(buf), "|%02d:%02d", ticket.minuteOfDay / 60, ticket.minuteOfDay % 60);
+            writer.write(buf);
+        }
+        writer.put('\n');
+        return;
+    }
+
+    snprintf(buf, sizeof(buf), "{\"serial\":%u,", ticket.serial);
+    writer.write(buf);
+    if (ticket.error)
+    {
+        writer.write("\"error\":");
+        writeJsonString(writer, ticket.error);
+        writer.write("}\n");
+        return;
+    }
+    writer.write("\"source\":");
+    writeJsonString(writer, stationName(ticket.source));
+    writer.write(",\"destination\":");
+    writeJsonString(writer, stationName(ticket.destination));
+    snprintf(buf, sizeof(buf), ",\"distance\":%d,\"fare\":%s,\"time\":", ticket.distance, formatPrice(ticket.farePaise / 100.0).c_str());
+    writer.write(buf);
+    if (ticket.minuteOfDay >= 0)
+    {
+        snprintf(buf, sizeof(buf), "\"%02d:%02d\"", ticket.minuteOfDay / 60, ticket.minuteOfDay % 60);
+        writer.write(buf);
+    }
+    else
+    {
+        writer.write("null");
+    }
+    writer.write(",\"path\":[");
+    for (size_t i = 0; i < ticket.path.size(); ++i)
+    {
+        if (i > 0)
+            writer.put(',');
+        writeJsonString(writer, nodeName(ticket.path[i]));
+    }
+    writer.write("]}\n");
+}
+
+// Issues one ticket per request line ("<source>|<destination>[|<HH:MM>]",
+// empty lines and '#' comments skipped) and renders them in input order with
+// serial numbers 1, 2, ... As in runBatch, the workers route one block while
+// the previous block is rendered. A throughput summary goes to stderr.
+void runTicketIssuing(istream &in, FILE *out, int threads, TicketFormat format)
+{
+    WorkerPool pool(max(threads, 1) - 1);
+    BufferedWriter writer(out);
+
+    vector<string> lines[2];
+    vector<Ticket> tickets[2];
+    size_t count[2] = {0, 0};
+    uint32_t issued = 0;
+
+    auto begin = chrono::steady_clock::now();
+    int cur = 0;
+    bool havePrevious = false;
+
+    while (true)
+    {
+        // Lines and tickets are reused block after block
+        size_t &n = count[cur];
+        n = 0;
+        if (lines[cur].size() < BATCH_BLOCK_SIZE)
+        {
+            lines[cur].resize(BATCH_BLOCK_SIZE);
+            tickets[cur].resize(BATCH_BLOCK_SIZE);
+        }
+        while (n < BATCH_BLOCK_SIZE && getline(in, lines[cur][n]))
+        {
+            string &line = lines[cur][n];
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            if (line.empty() || line[0] == '#')
+                continue;
+            ++n;
+        }
+
+        uint32_t firstSerial = issued + 1;
+        issued += n;
+        pool.start(n, [&, cur, firstSerial](size_t i)
+                   { issueTicket(tickets[cur][i], firstSerial + i, lines[cur][i]); });
+
+        if (havePrevious)
+        {
+            int prev = cur ^ 1;
+            for (size_t i = 0; i < count[prev]; ++i)
+                renderTicket(tickets[prev][i], format, writer);
+        }
+
+        pool.wait();
+
+        if (n == 0)
+            break;
+        havePrevious = true;
+        cur ^= 1;
+    }
+    writer.flush();
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    fprintf(stderr, "Tickets: %u issued in %.3f s on %d threads, %.0f tickets/s\n",
+            issued, seconds, pool.size(), seconds > 0 ? issued / seconds : 0.0);
+    printRouteCacheStats();
+}
+
+// Isochrones for many origins: reads one station name per line and writes
+// <origin>|<station>|<distance>|... with every station within radius of it
+// (see reachableFromEach), or ERROR|<message>, one line per origin in input
+// order. Empty lines and lines starting with '#' are skipped.
+void runIsochrones(istream &in, FILE *out, int radius, int threads)
+{
+    BufferedWriter writer(out);
+    auto begin = chrono::steady_clock::now();
+    size_t origins = 0;
+
+    vector<string> names;
+    string line;
+    bool done = false;
+    while (!done)
+    {
+        names.clear();
+        while (names.size() < BATCH_BLOCK_SIZE && !(done = !getline(in, line)))
+        {
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            if (!line.empty() && line[0] != '#')
+                names.push_back(line);
+        }
+
+        vector<int> ids;
+        for (const string &name : names)
+            ids.push_back(findStation(name));
+        vector<int> valid;
+        copy_if(ids.begin(), ids.end(), back_inserter(valid), [](int id)
+                { return id != -1; });
+        vector<vector<StationDistance>> reached = reachableFromEach(valid, radius, threads);
+
+        size_t next = 0;
+        for (size_t i = 0; i < names.size(); ++i)
+        {
+            const string &name = names[i];
+            if (ids[i] == -1)
+            {
+                writer.write("ERROR|Invalid station name: " + name + "\n");
+                continue;
+            }
+            string answer = name;
+            for (const StationDistance &entry : reached[next++])
+                answer += "|" + string(stationName(entry.station)) + "|" + to_string(entry.distance);
+            answer += '\n';
+            writer.write(answer);
+        }
+        origins += names.size();
+    }
+    writer.flush();
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    fprintf(stderr, "Isochrones: %zu origins within %d in %.3f s on %d threads, %.0f origins/s\n",
+            origins, radius, seconds, max(threads, 1), seconds > 0 ? origins / seconds : 0.0);
+}
+
+// Flow assignment of a demand file, one "<source>|<destination>|<trips>"
+// line per station pair (empty lines and '#' comments skipped; a pair may
+// repeat, its trips add up). Writes the loads, see assignFlows():
+//   SEGMENT|<from>|<to>|<line>|<trips>   one direction of a segment, in node order
+//   INTERCHANGE|<station>|<trips>        line changes at a station
+// Returns false, naming the line, at the first line that cannot be read.
+bool runAssignment(istream &in, FILE *out, int threads, double capacity, int iterations)
+{
+    auto begin = chrono::steady_clock::now();
+    vector<OdDemand> demand;
+    string line;
+    int lineNo = 0;
+    while (getline(in, line))
+    {
+        ++lineNo;
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        string_view text = line;
+        size_t first = text.find('|');
+        size_t second = first == string_view::npos ? first : text.find('|', first + 1);
+        if (second == string_view::npos)
+        {
+            cerr << "Demand line " << lineNo << ": expected <source>|<destination>|<trips>\n";
+            return false;
+        }
+        int source = findStation(text.substr(0, first));
+        int destination = findStation(text.substr(first + 1, second - first - 1));
+        char *end;
+        double trips = strtod(line.c_str() + second + 1, &end);
+        if (source == -1 || destination == -1)
+        {
+            cerr << "Demand line " << lineNo << ": invalid station name\n";
+            return false;
+        }
+        if (end == line.c_str() + second + 1 || *end != '\0' || !(trips >= 0))
+        {
+            cerr << "Demand line " << lineNo << ": bad number of trips\n";
+            return false;
+        }
+        demand.push_back({source, destination, trips});
+    }
+
+    FlowAssignment flows = assignFlows(demand, threads, capacity, iterations);
+
+    BufferedWriter writer(out);
+    char trips[32];
+    for (const SegmentLoad &segment : flows.segments)
+    {
+        snprintf(trips, sizeof(trips), "%.0f", segment.trips);
+        writer.write("SEGMENT|");
+        writer.write(nodeName(segment.fromNode));
+        writer.put('|');
+        writer.write(nodeName(segment.toNode));
+        writer.put('|');
+        writer.put(engine->stations.nodeLine[segment.fromNode]);
+        writer.put('|');
+        writer.write(trips);
+        writer.put('\n');
+    }
+    for (const InterchangeLoad &interchange : flows.interchanges)
+    {
+        snprintf(trips, sizeof(trips), "%.0f", interchange.trips);
+        writer.write("INTERCHANGE|");
+        writer.write(stationName(interchange.station));
+        writer.put('|');
+        writer.write(trips);
+        writer.put('\n');
+    }
+    writer.flush();
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    fprintf(stderr, "Assignment: %.0f trips over %zu pairs in %.3f s on %d threads, %d iterations",
+            flows.assignedTrips, demand.size(), seconds, max(threads, 1), flows.iterations);
+    if (capacity > 0)
+        fprintf(stderr, ", relative gap %.4f", flows.relativeGap);
+    if (flows.unroutedTrips > 0)
+        fprintf(stderr, ", %.0f trips between unconnected stations", flows.unroutedTrips);
+    fprintf(stderr, "\n");
+    return true;
+}
+
+// Replaces the copy of liveRouting that server workers route on as a
+// whole. A worker keeps the copy it started a query with, so a disruption
+// never waits for the queries in flight and they never see it half applied.
+void publishRouting()
+{
+    atomic_store(&engine->publishedRouting, make_shared<const RoutingState>(engine->liveRouting));
+}
+
+// Routes the searches of this thread on the published state while it exists
+class RoutingPin
+{
+public:
+    RoutingPin() : state(atomic_load(&engine->publishedRouting)), saved(routing) { routing = state.get(); }
+    ~RoutingPin() { routing = saved; }
+
+    RoutingPin(const RoutingPin &) = delete;
+    RoutingPin &operator=(const RoutingPin &) = delete;
+
+private:
+    shared_ptr<const RoutingState> state;
+    const RoutingState *saved;
+};
+
+#ifndef _WIN32
+// Opens the listening socket: a Unix socket if address contains a '/',
+// otherwise a TCP port on 127.0.0.1. Returns -1 on failure.
+int listenOn(const string &address)
+{
+    int fd = -1;
+    bool bound = false;
+    if (address.find('/') != string::npos)
+    {
+        sockaddr_un addr{};
+        if (address.size() >= sizeof(addr.sun_path))
+        {
+            cerr << "Socket path too long: " << address << "\n";
+            return -1;
+        }
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, address.c_str());
+
+        // A socket left behind by an earlier run, never any other kind of file
+        struct stat st;
+        if (stat(address.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+            unlink(address.c_str());
+
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        bound = fd >= 0 && bind(fd, (sockaddr *)&addr, sizeof(addr)) == 0;
+    }
+    else
+    {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(atoi(address.c_str()));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        int reuse = 1;
+        bound = fd >= 0 && setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) == 0 &&
+                bind(fd, (sockaddr *)&addr, sizeof(addr)) == 0;
+    }
+
+    if (!bound || listen(fd, SOMAXCONN) != 0)
+    {
+        cerr << "Cannot listen on " << address << ": " << strerror(errno) << "\n";
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Sends all of data, false once the client has gone away
+bool sendAll(int fd, string_view data)
+{
+    while (!data.empty())
+    {
+        ssize_t sent = send(fd, data.data(), data.size(), 0);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return false;
+        data.remove_prefix(sent);
+    }
+    return true;
+}
+
+// Longest query line a client may send; a connection that goes past it
+// without a newline gets an ERROR line and is closed
+const size_t SERVER_LINE_LIMIT = 1 << 16;
+
+// Answers the lines of one connection until the client closes it. All
+// complete lines of one read are answered with a single send, so clients
+// may pipeline their queries.
+void serveConnection(int fd, mutex &updateMutex)
+{
+    string input, output;
+    char buffer[1 << 16];
+    while (true)
+    {
+        ssize_t got = recv(fd, buffer, sizeof(buffer), 0);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            break;
+        input.append(buffer, got);
+
+        size_t start = 0, end;
+        while ((end = input.find('\n', start)) != string::npos)
+        {
+            string line = input.substr(start, end - start);
+            start = end + 1;
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            if (line.empty() || line[0] == '#')
+                continue;
+
+            if (isDisruptionRecord(line))
+            {
+                lock_guard<mutex> lock(updateMutex);
+                string answer = applyDisruption(line);
+                if (answer.compare(0, 6, "ERROR|") != 0)
+                    publishRouting();
+                output += answer;
+            }
+            else
+            {
+                RoutingPin pin;
+                output += answerBatchQuery(line);
+            }
+            output += '\n';
+        }
+        input.erase(0, start);
+
+        bool tooLong = input.size() > SERVER_LINE_LIMIT;
+        if (tooLong)
+            output += "ERROR|Line longer than " + to_string(SERVER_LINE_LIMIT) + " bytes\n";
+        if (!sendAll(fd, output) || tooLong)
+            break;
+        output.clear();
+    }
+    close(fd);
+}
+
+// Long-running query server. Clients send batch queries (see
+// answerBatchQuery) and disruption records (see applyDisruption) one per
+// line and get one answer line for each, in order. A fixed pool of
+// threads serves one connection each at a time; more connections wait
+// for a free thread. Queries route on the published state, disruptions
+// are applied to liveRouting one at a time and then published.
+int runServer(const string &address, int threads)
+{
+    int listener = listenOn(address);
+    if (listener < 0)
+        return 1;
+    signal(SIGPIPE, SIG_IGN); // a client that hangs up is noticed by send()
+    publishRouting();
+
+    mutex queueMutex, updateMutex;
+    condition_variable queueReady;
+    queue<int> waiting;
+    bool stopping = false;
+
+    threads = max(threads, 1);
+    EngineState &state = *engine;
+    vector<thread> workers;
+    for (int i = 0; i < threads; ++i)
+    {
+        workers.emplace_back([&]
+                             {
+            EngineScope scope(state);
+            while (true)
+            {
+                unique_lock<mutex> lock(queueMutex);
+                queueReady.wait(lock, [&] { return stopping || !waiting.empty(); });
+                if (waiting.empty())
+                    return;
+                int fd = waiting.front();
+                waiting.pop();
+                lock.unlock();
+                serveConnection(fd, updateMutex);
+            } });
+    }
+
+    fprintf(stderr, "Serving on %s with %d threads\n", address.c_str(), threads);
+    while (true)
+    {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            cerr << "accept failed: " << strerror(errno) << "\n";
+            break;
+        }
+        {
+            lock_guard<mutex> lock(queueMutex);
+            waiting.push(fd);
+        }
+        queueReady.notify_one();
+    }
+
+    {
+        lock_guard<mutex> lock(queueMutex);
+        stopping = true;
+    }
+    queueReady.notify_all();
+    for (thread &worker : workers)
+        worker.join();
+    close(listener);
+    return 1;
+}
+#else
+int runServer(const string &address, int threads)
+{
+    cerr << "--serve needs POSIX sockets\n";
+    return 1;
+}
+#endif
+
+// Approximate heap memory held by the network: graph, hierarchy, search index
+// and station table
+size_t networkMemoryBytes()
+{
+    auto bytes = [](const auto &v)
+    { return v.capacity() * sizeof(v[0]); };
+
+    const CsrGraph &graph = engine->liveRouting.graph;
+    const ContractionHierarchy &hierarchy = engine->liveRouting.hierarchy;
+    size_t total = bytes(graph.offsets) + bytes(graph.targets) + bytes(graph.weights);
+    total += bytes(hierarchy.rank) + bytes(hierarchy.upOffsets) + bytes(hierarchy.upTargets) +
+             bytes(hierarchy.upWeights) + bytes(hierarchy.upMiddle);
+    total += engine->searchIndex.text.capacity() + bytes(engine->searchIndex.nameStart) +
+             bytes(engine->searchIndex.byName) + bytes(engine->searchIndex.suffixes) + bytes(engine->searchIndex.posToName);
+    total += engine->stations.nameArena.capacity() + bytes(engine->stations.nameOffsets) + bytes(engine->stations.hashSlots) +
+             bytes(engine->stations.nodeStation) + bytes(engine->stations.nodeLine) +
+             bytes(engine->stations.stationNodeOffsets) + bytes(engine->stations.stationNodeList);
+
+    return total;
+}
+
+// Resident set size of the process, or 0 where /proc is not available
+size_t residentMemoryBytes()
+{
+    ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    if (!(statm >> pages >> resident))
+        return 0;
+#ifndef _WIN32
+    return resident * sysconf(_SC_PAGESIZE);
+#else
+    return 0;
+#endif
+}
+
+// Runs op(i) for i = 0, 1, ... until minMs have passed (at least minRuns times)
+// and returns the average nanoseconds per call
+double measureNs(const function<void(int)> &op, double minMs = 200, int minRuns = 3)
+{
+    auto begin = chrono::steady_clock::now();
+    int runs = 0;
+    double elapsedMs = 0;
+    while (runs < minRuns || elapsedMs < minMs)
+    {
+        op(runs++);
+        elapsedMs = chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count();
+    }
+    return elapsedMs * 1e6 / runs;
+}
+
+// Benchmarks every planner on synthetic networks of growing size. Writes one
+// JSON object per line to out, e.g.
+//   {"lines":16,"stations_per_line":100,"nodes":1625,"edges":3366,"op":"dijkstra","ns_per_query":41000,...}
+// so runs can be diffed or plotted as scaling curves.
+void runBenchmarks(const vector<SyntheticNetworkSpec> &specs, FILE *out)
+{
+    BufferedWriter writer(out);
+
+    // Time the planners themselves; the cache gets its own entry below
+    engine->routeCache->setCapacity(0);
+
+    for (const SyntheticNetworkSpec &spec : specs)
+    {
+        auto buildStart = chrono::steady_clock::now();
+        if (!loadSyntheticNetwork(spec))
+            continue;
+        buildGraph();
+        buildSearchIndex();
+        double buildMs = chrono::duration<double, milli>(chrono::steady_clock::now() - buildStart).count();
+
+        int n = engine->liveRouting.graph.size();
+        mt19937 rng(spec.seed);
+        int stationTotal = engine->stations.stationCount();
+        auto randomStation = [&]
+        { return (int)(rng() % stationTotal); };
+        auto randomStations = [&](int k)
+        {
+            vector<int> picked(stationTotal);
+            for (int s = 0; s < stationTotal; ++s)
+                picked[s] = s;
+            shuffle(picked.begin(), picked.end(), rng);
+            picked.resize(min<size_t>(k, picked.size()));
+            return picked;
+        };
+
+        // Query inputs are drawn up front so only the algorithms are timed
+        const int inputs = 256;
+        vector<int> sources(inputs);
+        vector<pair<int, int>> pairs(inputs);
+        vector<string> patterns(inputs), typos(inputs);
+        for (int i = 0; i < inputs; ++i)
+        {
+            sources[i] = rng() % n;
+            pairs[i] = {randomStation(), randomStation()};
+            string name(stationName(randomStation()));
+            size_t len = min<size_t>(name.size(), 3 + rng() % 4);
+            patterns[i] = name.substr(rng() % (name.size() - len + 1), len);
+            typos[i] = name;
+            typos[i][rng() % name.size()] = 'a' + rng() % 26;
+        }
+        vector<vector<int>> exactTrips, largeTrips, groups;
+        for (int i = 0; i < 8; ++i)
+        {
+            exactTrips.push_back(randomStations(12));
+            largeTrips.push_back(randomStations(50));
+            groups.push_back(randomStations(10));
+        }
+
+        vector<int> dist, prev;
+        size_t sink = 0;
+        struct BenchResult
+        {
+            string op;
+            double nsPerQuery;
+            double settledPerQuery; // -1 for operations that are not a single route search
+        };
+        vector<BenchResult> results;
+
+        // Times the point-to-point route with the current search strategy
+        // and counts the nodes it settles per query
+        auto routeResult = [&](const string &op)
+        {
+            double ns = measureNs([&](int i)
+                                  { sink += shortestRoute(pairs[i % inputs].first, pairs[i % inputs].second).distance; });
+            long long before = settledNodes;
+            for (const auto &pair : pairs)
+                sink += shortestRoute(pair.first, pair.second).distance;
+            results.push_back({op, ns, double(settledNodes - before) / inputs});
+        };
+
+        results.push_back({"dijkstra", measureNs([&](int i)
+                                                 { dijkstra(sources[i % inputs], dist, prev); sink += dist[0]; }), -1});
+        routeResult("getShortestPath");
+
+        engine->bidirectionalSearch = true;
+        routeResult("getShortestPath_bidir");
+        engine->bidirectionalSearch = false;
+
+        auto altStart = chrono::steady_clock::now();
+        buildLandmarks(DEFAULT_LANDMARK_COUNT);
+        double altBuildMs = chrono::duration<double, milli>(chrono::steady_clock::now() - altStart).count();
+        routeResult("getShortestPath_alt");
+        engine->liveRouting.landmarkTable = LandmarkTable();
+        results.push_back({"search", measureNs([&](int i)
+                                               { sink += searchStations(patterns[i % inputs], SEARCH_RESULT_LIMIT).size(); }), -1});
+        results.push_back({"fuzzySearch", measureNs([&](int i)
+                                                    { sink += fuzzySearchStations(typos[i % inputs], SEARCH_RESULT_LIMIT).size(); }), -1});
+        results.push_back({"tsp_12_stops", measureNs([&](int i)
+                                                     { sink += tsp(stationDistanceMatrix(exactTrips[i % 8]), true).total; }), -1});
+        results.push_back({"heuristic_tsp_50_stops", measureNs([&](int i)
+                                                               { sink += heuristicTsp(stationDistanceMatrix(largeTrips[i % 8]), true, HEURISTIC_TRIP_BUDGET_MS, 1).plan.total; }), -1});
+        results.push_back({"findBestMeetingPoint_10_friends", measureNs([&](int i)
+                                                                        { sink += findMeetingPoints(groups[i % 8], MeetingObjective::MinMax, 1).size(); }), -1});
+
+        auto chStart = chrono::steady_clock::now();
+        buildContractionHierarchy();
+        double chBuildMs = chrono::duration<double, milli>(chrono::steady_clock::now() - chStart).count();
+        routeResult("getShortestPath_ch");
+
+        // The same pairs again and again, as in skewed real traffic
+        engine->routeCache->setCapacity(DEFAULT_ROUTE_CACHE_SIZE);
+        results.push_back({"getShortestPath_cached", measureNs([&](int i)
+                                                               { sink += shortestRoute(pairs[i % inputs].first, pairs[i % inputs].second).distance; }), -1});
+        engine->routeCache->setCapacity(0);
+
+        size_t memory = networkMemoryBytes();
+        size_t rss = residentMemoryBytes();
+        engine->liveRouting.hierarchy = ContractionHierarchy();
+
+        for (const BenchResult &result : results)
+        {
+            char settled[48] = "";
+            if (result.settledPerQuery >= 0)
+                snprintf(settled, sizeof(settled), ",\"settled_per_query\":%.0f", result.settledPerQuery);
+
+            char line[512];
+            snprintf(line, sizeof(line),
+                     "{\"lines\":%d,\"stations_per_line\":%d,\"interchanges\":%d,\"branches\":%d,"
+                     "\"nodes\":%d,\"edges\":%zu,\"op\":\"%s\",\"ns_per_query\":%.0f%s,"
+                     "\"build_ms\":%.2f,\"ch_build_ms\":%.2f,\"alt_build_ms\":%.2f,\"memory_bytes\":%zu,\"rss_bytes\":%zu}\n",
+                     spec.lines, spec.stationsPerLine, spec.interchanges, spec.branches,
+                     n, engine->liveRouting.graph.targets.size() / 2, result.op.c_str(), result.nsPerQuery, settled,
+                     buildMs, chBuildMs, altBuildMs, memory, rss);
+            writer.write(line);
+        }
+        writer.flush();
+
+        // Keeps the timed calls from being optimised away: a volatile store
+        // has to happen, so sink and everything it sums has to be computed
+        volatile size_t keep = sink;
+        (void)keep;
+    }
+}
+
+} // namespace
+
+// Parses "LINESxSTATIONS[xINTERCHANGES[xBRANCHES]],..." e.g. "4x40,16x100x40x4".
+// Interchanges default to two per line and branches to one per four lines.
+bool parseBenchmarkSizes(const string &text, vector<SyntheticNetworkSpec> &specs)
+{
+    for (const string &item : splitFields(text, ','))
+    {
+        vector<string> parts = splitFields(item, 'x');
+        if (parts.size() < 2 || parts.size() > 4)
+            return false;
+
+        SyntheticNetworkSpec spec;
+        spec.lines = atoi(parts[0].c_str());
+        spec.stationsPerLine = atoi(parts[1].c_str());
+        spec.interchanges = parts.size() > 2 ? atoi(parts[2].c_str()) : spec.lines * 2;
+        spec.branches = parts.size() > 3 ? atoi(parts[3].c_str()) : spec.lines / 4;
+        spec.seed = 12345;
+        if (spec.lines < 1 || spec.stationsPerLine < 2)
+            return false;
+        specs.push_back(spec);
+    }
+    return !specs.empty();
+}
+
+namespace
+{
+
+// Built-in Delhi Metro network, used when no network file or snapshot is given
+void loadDefaultNetwork()
+{
+    // Red Line Stations
+    vector<string> redLineStations = {
+        "Shaheed Sthal (New Bus Adda)", "Hindon River", "Arthala", "Mohan Nagar",
+        "Shyam Park", "Major Mohit Sharma Rajendra Nagar", "Raj Bagh", "Shaheed Nagar",
+        "Dilshad Garden", "Jhilmil", "Mansarovar Park", "Shahdara", "Welcome",
+        "Seelampur", "Shastri Park", "Kashmere Gate", "Tis Hazari", "Pul Bangash",
+        "Pratap Nagar", "Shastri Nagar", "Inderlok", "Kanhaiya Nagar", "Keshav Puram",
+        "Netaji Subhash Place", "Kohat Enclave", "Pitampura", "Rohini East",
+        "Rohini West", "Rithala"};
+
+    // Blue Line Stations (Main Line and Branch Line)
+    vector<string> blueLineStations = {
+        // Main Line
+        "Dwarka Sector 21", "Dwarka Sector 8", "Dwarka Sector 9", "Dwarka Sector 10",
+        "Dwarka Sector 11", "Dwarka Sector 12", "Dwarka Sector 13", "Dwarka Sector 14",
+        "Dwarka", "Dwarka Mor", "Nawada", "Uttam Nagar West", "Uttam Nagar East",
+        "Janakpuri West", "Janakpuri East", "Tilak Nagar", "Subhash Nagar",
+        "Tagore Garden", "Rajouri Garden", "Ramesh Nagar", "Moti Nagar",
+        "Kirti Nagar", "Shadipur", "Patel Nagar", "Rajendra Place", "Karol Bagh",
+        "Jhandewalan", "Ramakrishna Ashram Marg", "Rajiv Chowk", "Barakhamba Road",
+        "Mandi House", "Pragati Maidan", "Indraprastha", "Yamuna Bank",
+        "Akshardham", "Mayur Vihar Phase-1", "Mayur Vihar Extention",
+        "New Ashok Nagar", "Noida Sector 15", "Noida Sector 16", "Noida Sector 18",
+        "Botanical Garden", "Golf Course", "Noida City Centre", "Noida Sector 34",
+        "Noida Sector 52", "Noida Sector 61", "Noida Sector 59", "Noida Sector 62",
+        "Noida Electronic City",
+        // Branch Line
+        "Yamuna Bank", "Laxmi Nagar", "Nirman Vihar", "Preet Vihar", "Karkarduma",
+        "Anand Vihar", "Kaushambi", "Vaishali"};
+
+    // Yellow Line Stations
+    vector<string> yellowLineStations = {
+        "Samaypur Badli", "Rohini Sector 18,19", "Haiderpur Badli Mor", "Jahangirpuri",
+        "Adarsh Nagar", "Azadpur", "Model Town", "GTB Nagar", "Vishwa Vidyalaya",
+        "Vidhan Sabha", "Civil Lines", "Kashmere Gate", "Chandni Chowk",
+        "Chawri Bazar", "New Delhi", "Rajiv Chowk", "Patel Chowk", "Central Secretariat",
+        "Udyog Bhawan", "Lok Kalyan Marg", "Jor Bagh", "INA", "AIIMS", "Green Park",
+        "Hauz Khas", "Malviya Nagar", "Saket", "Qutub Minar", "Chhatarpur",
+        "Sultanpur", "Ghitorni", "Arjan Garh", "Guru Dronacharya", "Sikandarpur",
+        "MG Road", "IFFCO Chowk", "Huda City Centre"};
+
+    // Pink Line Stations
+    vector<string> pinkLineStations = {
+        "Majlis Park", "Azadpur", "Shalimar Bagh", "Netaji Subhash Place", "Shakurpur",
+        "Punjabi Bagh West", "ESI Hospital", "Rajouri Garden", "Mayapuri", "Naraina Vihar",
+        "Delhi Cantt", "Durgabai Deshmukh South Campus", "Sir M. Vishweshwaraiah Moti Bagh",
+        "Bhikaji Cama Place", "Sarojini Nagar", "INA", "South Extension", "Lajpat Nagar",
+        "Vinobapuri", "Ashram", "Hazrat Nizamuddin", "Mayur Vihar Phase-1",
+        "Mayur Vihar Pocket-1", "Trilokpuri Sanjay Lake", "Vinod Nagar East",
+        "Mandawali - West Vinod Nagar", "IP Extension", "Anand Vihar", "Karkarduma",
+        "Karkarduma Court", "Krishna Nagar", "East Azad Nagar", "Welcome", "Jaffrabad",
+        "Maujpur - Babarpur", "Gokulpuri", "Johri Enclave", "Shiv Vihar"};
+
+    initializeGraph();
+
+    // Consecutive stations in each line are 1 KM apart: R0-R1-R2-R3..., B0-B1...
+    addLine(redLineStations, 'R');
+    addLine(blueLineStations, 'B');
+    addLine(yellowLineStations, 'Y');
+    addLine(pinkLineStations, 'P');
+
+    vector<string> interchanges = {
+        "Azadpur",
+        "Kashmere Gate",
+        "Rajiv Chowk",
+        "Welcome",
+        "Yamuna Bank",
+        "Mandi House",
+        "Central Secretariat",
+        "Anand Vihar",
+        "Mayur Vihar Phase-1",
+        "INA"};
+
+    for (const auto &s : interchanges) {
+        addInterchange(s);
+    }
+}
+
+} // namespace
+
+EngineState::EngineState()
+    : routeCache(make_unique<RouteCache>(DEFAULT_ROUTE_CACHE_SIZE)), timetable(make_unique<Timetable>()),
+      odMatrix(make_unique<OdMatrix>())
+{
+}
+
+EngineState::~EngineState() = default;
+
+// Every method makes its engine current for the calls it makes (free
+// functions are named with :: where a method has the same name)
+MetroEngine::MetroEngine() : state(make_unique<EngineState>()) {}
+
+MetroEngine::~MetroEngine() = default;
+
+void MetroEngine::loadDefaultNetwork()
+{
+    EngineScope scope(*state);
+    clearNetwork();
+    ::loadDefaultNetwork();
+    buildGraph();
+    buildSearchIndex();
+}
+
+bool MetroEngine::loadNetworkFile(const string &fileName)
+{
+    EngineScope scope(*state);
+    clearNetwork();
+    if (!::loadNetworkFile(fileName))
+        return false;
+    buildGraph();
+    buildSearchIndex();
+    return true;
+}
+
+bool MetroEngine::loadSyntheticNetwork(const SyntheticNetworkSpec &spec)
+{
+    EngineScope scope(*state);
+    if (!::loadSyntheticNetwork(spec))
+        return false;
+    buildGraph();
+    buildSearchIndex();
+    return true;
+}
+
+bool MetroEngine::loadSnapshot(const string &fileName)
+{
+    EngineScope scope(*state);
+    return ::loadSnapshot(fileName);
+}
+
+bool MetroEngine::writeSnapshot(const string &fileName)
+{
+    EngineScope scope(*state);
+    return ::writeSnapshot(fileName);
+}
+
+void MetroEngine::buildContractionHierarchy()
+{
+    EngineScope scope(*state);
+    ::buildContractionHierarchy();
+}
+
+bool MetroEngine::hasContractionHierarchy() const
+{
+    return !state->liveRouting.hierarchy.empty();
+}
+
+void MetroEngine::buildLandmarks(int count)
+{
+    EngineScope scope(*state);
+    ::buildLandmarks(count);
+}
+
+void MetroEngine::setBidirectionalSearch(bool enabled)
+{
+    state->bidirectionalSearch = enabled;
+}
+
+void MetroEngine::setRouteCacheCapacity(size_t routes)
+{
+    state->routeCache->setCapacity(routes);
+}
+
+bool MetroEngine::loadFareFile(const string &fileName)
+{
+    EngineScope scope(*state);
+    return ::loadFareFile(fileName);
+}
+
+bool MetroEngine::hasFarePeriods() const
+{
+    return !state->fareRules.periods.empty();
+}
+
+bool MetroEngine::buildTimetable(const string &settingsFile)
+{
+    EngineScope scope(*state);
+    TimetableSpec spec;
+    if (!settingsFile.empty() && !loadTimetableFile(settingsFile, spec))
+        return false;
+    ::buildTimetable(spec);
+    return true;
+}
+
+bool MetroEngine::hasTimetable() const
+{
+    return !state->timetable->empty();
+}
+
+string MetroEngine::applyDisruption(const string &record)
+{
+    EngineScope scope(*state);
+    return ::applyDisruption(record);
+}
+
+bool MetroEngine::loadDisruptionFile(const string &fileName)
+{
+    EngineScope scope(*state);
+    return ::loadDisruptionFile(fileName);
+}
+
+int MetroEngine::stationCount() const
+{
+    return state->stations.stationCount();
+}
+
+int MetroEngine::findStation(string_view name) const
+{
+    return state->stations.find(name);
+}
+
+string_view MetroEngine::stationName(int station) const
+{
+    return state->stations.name(station);
+}
+
+string_view MetroEngine::nodeName(int node) const
+{
+    return state->stations.name(state->stations.nodeStation[node]);
+}
+
+vector<int> MetroEngine::searchStations(const string &query, size_t limit)
+{
+    EngineScope scope(*state);
+    return ::searchStations(query, limit);
+}
+
+vector<FuzzyMatch> MetroEngine::fuzzySearchStations(const string &query, size_t limit, int maxErrors)
+{
+    EngineScope scope(*state);
+    return ::fuzzySearchStations(query, limit, maxErrors);
+}
+
+bool MetroEngine::shortestRoute(int srcStation, int destStation, Route &route)
+{
+    EngineScope scope(*state);
+    RouteResult result = ::shortestRoute(srcStation, destStation);
+    route.distance = result.distance;
+    route.farePaise = result.farePaise;
+    route.path.assign(result.path.begin(), result.path.end());
+    return !route.path.empty();
+}
+
+vector<AlternativeRoute> MetroEngine::alternativeRoutes(int srcStation, int destStation, int k)
+{
+    EngineScope scope(*state);
+    return ::alternativeRoutes(srcStation, destStation, k);
+}
+
+vector<ParetoRoute> MetroEngine::paretoRoutes(int srcStation, int destStation)
+{
+    EngineScope scope(*state);
+    return ::paretoRoutes(srcStation, destStation);
+}
+
+vector<StationDistance> MetroEngine::reachableStations(int srcStation, int radius)
+{
+    EngineScope scope(*state);
+    return ::reachableStations(srcStation, radius);
+}
+
+vector<vector<StationDistance>> MetroEngine::reachableFromEach(const vector<int> &srcStations, int radius, int threads)
+{
+    EngineScope scope(*state);
+    return ::reachableFromEach(srcStations, radius, threads);
+}
+
+vector<MeetingPoint> MetroEngine::findMeetingPoints(const vector<int> &friendStations, MeetingObjective objective,
+                                                    size_t topN, int threads)
+{
+    EngineScope scope(*state);
+    return ::findMeetingPoints(friendStations, objective, topN, threads);
+}
+
+TripPlan MetroEngine::planTrip(const vector<int> &stops, bool returnToStart)
+{
+    EngineScope scope(*state);
+    if ((int)stops.size() > MAX_EXACT_TRIP_STOPS)
+        return planTripHeuristic(stops, returnToStart).plan;
+    return tsp(stationDistanceMatrix(stops), returnToStart);
+}
+
+HeuristicTripResult MetroEngine::planTripHeuristic(const vector<int> &stops, bool returnToStart, int budgetMs, unsigned seed)
+{
+    EngineScope scope(*state);
+    return heuristicTsp(stationDistanceMatrix(stops), returnToStart, budgetMs, seed);
+}
+
+Journey MetroEngine::earliestArrival(int srcStation, int destStation, int departure)
+{
+    EngineScope scope(*state);
+    return hasTimetable() ? ::earliestArrival(srcStation, destStation, departure) : Journey();
+}
+
+vector<ProfileEntry> MetroEngine::profileQuery(int srcStation, int destStation, int from, int to)
+{
+    EngineScope scope(*state);
+    return hasTimetable() ? ::profileQuery(srcStation, destStation, from, to) : vector<ProfileEntry>();
+}
+
+FlowAssignment MetroEngine::assignFlows(const vector<OdDemand> &demand, int threads, double capacity, int iterations)
+{
+    EngineScope scope(*state);
+    return ::assignFlows(demand, threads, capacity, iterations);
+}
+
+void MetroEngine::issueTicket(Ticket &ticket, uint32_t serial, int source, int destination, int minuteOfDay)
+{
+    EngineScope scope(*state);
+    ::issueTicket(ticket, serial, source, destination, minuteOfDay);
+}
+
+string MetroEngine::answerQuery(const string &line)
+{
+    EngineScope scope(*state);
+    return answerBatchQuery(line);
+}
+
+void MetroEngine::runBatch(istream &in, FILE *out, int threads)
+{
+    EngineScope scope(*state);
+    ::runBatch(in, out, threads);
+}
+
+void MetroEngine::runTicketIssuing(istream &in, FILE *out, int threads, TicketFormat format)
+{
+    EngineScope scope(*state);
+    ::runTicketIssuing(in, out, threads, format);
+}
+
+void MetroEngine::runIsochrones(istream &in, FILE *out, int radius, int threads)
+{
+    EngineScope scope(*state);
+    ::runIsochrones(in, out, radius, threads);
+}
+
+bool MetroEngine::runAssignment(istream &in, FILE *out, int threads, double capacity, int iterations)
+{
+    EngineScope scope(*state);
+    return ::runAssignment(in, out, threads, capacity, iterations);
+}
+
+void MetroEngine::runBenchmarks(const vector<SyntheticNetworkSpec> &specs, FILE *out)
+{
+    EngineScope scope(*state);
+    ::runBenchmarks(specs, out);
+}
+
+int MetroEngine::serve(const string &address, int threads)
+{
+    EngineScope scope(*state);
+    return runServer(address, threads);
+}
+
+bool MetroEngine::writeOdMatrix(const string &fileName, int threads)
+{
+    EngineScope scope(*state);
+    return ::writeOdMatrix(fileName, threads);
+}
+
+bool MetroEngine::loadOdMatrix(const string &fileName)
+{
+    EngineScope scope(*state);
+    return state->odMatrix->open(fileName);
+}
+
+bool MetroEngine::writeMetricsFile(const string &fileName)
+{
+    EngineScope scope(*state);
+    return ::writeMetricsFile(fileName);
+}
@@ -0,0 +1,326 @@
+// MetroGo routing engine as a library. Everything runs through a MetroEngine:
+// each one owns its network, routing tables, fares, caches and metrics, so a
+// process can hold any number of them. Results come back as the plain structs
+// below and nothing is read from or written to the console, except for the
+// stream drivers (runBatch, runTicketIssuing, ...) that write to the FILE
+// they are given and put a summary and errors on stderr.
+//
+// Station ids are dense, 0 .. stationCount() - 1, in order of first
+// appearance; a node is one station on one line (see nodeName()).
+// Methods that take station ids expect valid ones, see findStation().
+// One engine may be queried from many threads at once, but loading,
+// building and disruptions must not run alongside anything else on it.
+#ifndef METROGO_H
+#define METROGO_H
+
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <istream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Number of suggestions shown for a partial station name
+const size_t SEARCH_RESULT_LIMIT = 20;
+
+// Landmarks chosen by default with --alt
+const int DEFAULT_LANDMARK_COUNT = 16;
+
+// Number of routes kept by default, see --cache
+const size_t DEFAULT_ROUTE_CACHE_SIZE = 4096;
+
+// Alternative routes for crowd diversion
+const int DEFAULT_ALTERNATIVE_COUNT = 5;
+
+// Largest number of stops the exact trip solver accepts (2^17 * 17 DP states)
+const int MAX_EXACT_TRIP_STOPS = 18;
+
+// Wall-clock budget for the heuristic planner used above that size
+const int HEURISTIC_TRIP_BUDGET_MS = 200;
+
+// Rounds of the congested flow assignment by default, see --iterations
+const int ASSIGNMENT_ITERATIONS = 20;
+
+// Shortest route between two stations. Owned by the caller and refilled in
+// place, so once path has grown a query allocates nothing.
+struct Route
+{
+    int distance = INT_MAX; // INT_MAX if the stations are not connected
+    int farePaise = 0;      // under the fare rules with no time of day
+    std::vector<int> path;  // node ids, source first
+};
+
+struct FuzzyMatch
+{
+    int station;
+    int errors; // edits to find the query in the name
+};
+
+// Result of multi trip planning: visiting order as indexes into the stop list
+// (always starting with stop 0) and the total distance
+struct TripPlan
+{
+    std::vector<int> order;
+    int total;
+};
+
+// Result of the heuristic trip optimiser
+struct HeuristicTripResult
+{
+    TripPlan plan;
+    long long lowerBound;
+    double gapPercent; // how far plan.total can at most be above the optimum
+    int restarts;
+    bool timedOut; // the budget ended the search early, so the plan may differ from run to run
+};
+
+enum class MeetingObjective
+{
+    MinMax, // shortest longest journey, ties broken by total distance
+    MinSum  // shortest total distance, ties broken by longest journey
+};
+
+struct MeetingPoint
+{
+    int station;
+    int maxDistance;
+    long long totalDistance;
+    std::vector<std::vector<int>> paths; // node route of every friend, in input order
+};
+
+// Shape of a generated test network
+struct SyntheticNetworkSpec
+{
+    int lines;
+    int stationsPerLine;
+    int interchanges; // stations shared by two lines
+    int branches;     // extra short lines leaving an existing line, like the Yamuna Bank branch
+    unsigned seed;
+};
+
+struct AlternativeRoute
+{
+    int distance;
+    double shared;         // fraction of the length on segments of better ranked routes
+    std::vector<int> path; // node ids
+};
+
+// Routes trading distance against line changes
+struct ParetoRoute
+{
+    int distance;          // on the lines only, changing lines adds nothing
+    int transfers;         // number of line changes
+    std::vector<int> path; // node ids
+};
+
+// Isochrones: every station within some distance of an origin
+struct StationDistance
+{
+    int station;
+    int distance;
+};
+
+// Trips a day from one station to another, the input of assignFlows()
+struct OdDemand
+{
+    int source;
+    int destination;
+    double trips;
+};
+
+// Trips a day on one direction of a segment between neighbouring stations
+struct SegmentLoad
+{
+    int fromNode;
+    int toNode;
+    double trips;
+};
+
+// Trips a day changing lines at a station
+struct InterchangeLoad
+{
+    int station;
+    double trips;
+};
+
+struct FlowAssignment
+{
+    std::vector<SegmentLoad> segments;         // loaded segments in node order
+    std::vector<InterchangeLoad> interchanges; // stations with line changes, by id
+    double assignedTrips = 0;                  // trips between different, connected stations
+    double unroutedTrips = 0;                  // trips between stations that are not connected
+    int iterations = 0;
+    double relativeGap = 0; // share of the travel cost above the shortest routes after the last
+                            // congested iteration; 0 for all-or-nothing
+};
+
+// One ride on one train
+struct JourneyLeg
+{
+    int trip;
+    int fromNode;
+    int toNode;
+    int departure;
+    int arrival;
+};
+
+struct Journey
+{
+    int arrival = INT_MAX; // INT_MAX if the destination cannot be reached that day
+    std::vector<JourneyLeg> legs;
+};
+
+// A departure and the earliest arrival it allows
+struct ProfileEntry
+{
+    int departure;
+    int arrival;
+};
+
+// One issued ticket. Tickets are kept in reusable slots and refilled in
+// place, so once the slots have grown issuing allocates nothing.
+struct Ticket
+{
+    uint32_t serial = 0;
+    int source = -1;
+    int destination = -1;
+    int distance = 0;
+    int farePaise = 0;
+    int minuteOfDay = -1;        // travel time, -1 if not given
+    const char *error = nullptr; // set instead of a route when the ticket cannot be issued
+    std::vector<int> path;       // node ids, source first
+};
+
+enum class TicketFormat
+{
+    Text,   // serial|source|destination|distance|fare|HH:MM, or serial|ERROR|message
+    Json,   // one object per line, with the route
+    Binary  // fixed-width TicketRecord
+};
+
+struct EngineState;
+
+class MetroEngine
+{
+public:
+    MetroEngine();
+    ~MetroEngine();
+
+    MetroEngine(const MetroEngine &) = delete;
+    MetroEngine &operator=(const MetroEngine &) = delete;
+
+    // Network. Every load replaces the network of this engine, drops the
+    // timetable and OD matrix of the old one and builds its graph and
+    // station search index; false (with the reason on stderr) if the file
+    // cannot be used.
+    void loadDefaultNetwork();
+    bool loadNetworkFile(const std::string &fileName);
+    bool loadSyntheticNetwork(const SyntheticNetworkSpec &spec);
+    bool loadSnapshot(const std::string &fileName);
+    bool writeSnapshot(const std::string &fileName);
+
+    // Faster point-to-point routes; all give plain Dijkstra distances.
+    // The hierarchy wins over landmarks, landmarks over bidirectional search.
+    void buildContractionHierarchy();
+    bool hasContractionHierarchy() const;
+    void buildLandmarks(int count = DEFAULT_LANDMARK_COUNT);
+    void setBidirectionalSearch(bool enabled);
+
+    // Routes kept for repeated station pairs, 0 turns the cache off.
+    // Empties the cache.
+    void setRouteCacheCapacity(size_t routes);
+
+    // Fare rules in the format of data/delhi_fares.txt
+    bool loadFareFile(const std::string &fileName);
+    bool hasFarePeriods() const;
+
+    // Timetable for earliestArrival() and profileQuery(), with the
+    // settings of a file such as data/delhi_timetable.txt or the defaults
+    bool buildTimetable(const std::string &settingsFile = "");
+    bool hasTimetable() const;
+
+    // Disruption records (CLOSE|a|b, WEIGHT|a|b|km, REOPEN|a|b, SUSPEND|s,
+    // RESUME|s); returns the answer line, ERROR|<message> if not applied
+    std::string applyDisruption(const std::string &record);
+    bool loadDisruptionFile(const std::string &fileName);
+
+    // Stations
+    int stationCount() const;
+    int findStation(std::string_view name) const; // -1 if there is no such station
+    std::string_view stationName(int station) const;
+    std::string_view nodeName(int node) const;
+    std::vector<int> searchStations(const std::string &query, size_t limit = SEARCH_RESULT_LIMIT);
+    std::vector<FuzzyMatch> fuzzySearchStations(const std::string &query, size_t limit = SEARCH_RESULT_LIMIT,
+                                                int maxErrors = -1);
+
+    // Routes. shortestRoute() refills route and returns false if the
+    // stations are not connected.
+    bool shortestRoute(int srcStation, int destStation, Route &route);
+    std::vector<AlternativeRoute> alternativeRoutes(int srcStation, int destStation, int k = DEFAULT_ALTERNATIVE_COUNT);
+    std::vector<ParetoRoute> paretoRoutes(int srcStation, int destStation);
+    std::vector<StationDistance> reachableStations(int srcStation, int radius);
+    std::vector<std::vector<StationDistance>> reachableFromEach(const std::vector<int> &srcStations, int radius, int threads = 1);
+    std::vector<MeetingPoint> findMeetingPoints(const std::vector<int> &friendStations, MeetingObjective objective,
+                                                size_t topN, int threads = 1);
+
+    // Visiting order of stops starting at stops[0]: exact for up to
+    // MAX_EXACT_TRIP_STOPS stops, otherwise the best order found within
+    // budgetMs together with a lower bound on the optimum. The same seed
+    // gives the same plan unless the budget runs out (timedOut); budgetMs 0
+    // sets no time limit and is always reproducible.
+    TripPlan planTrip(const std::vector<int> &stops, bool returnToStart);
+    HeuristicTripResult planTripHeuristic(const std::vector<int> &stops, bool returnToStart,
+                                          int budgetMs = HEURISTIC_TRIP_BUDGET_MS, unsigned seed = 1);
+
+    // Timetable queries, times in seconds after midnight
+    Journey earliestArrival(int srcStation, int destStation, int departure);
+    std::vector<ProfileEntry> profileQuery(int srcStation, int destStation, int from, int to);
+
+    // Puts the trips of a demand matrix on their routes and sums the load of
+    // every segment and interchange. With capacity 0 every trip takes its
+    // shortest route (all-or-nothing); otherwise segments with more than
+    // capacity trips a day in one direction get slower, and iterations
+    // rounds move trips towards the routes that are then the fastest.
+    FlowAssignment assignFlows(const std::vector<OdDemand> &demand, int threads = 1, double capacity = 0,
+                               int iterations = ASSIGNMENT_ITERATIONS);
+
+    // Routes and prices a ticket in place; minuteOfDay -1 applies no fare period
+    void issueTicket(Ticket &ticket, uint32_t serial, int source, int destination, int minuteOfDay = -1);
+
+    // One batch query line (PATH|a|b, TICKET|a|b, SEARCH|text, ...) and its
+    // answer line, as in --batch
+    std::string answerQuery(const std::string &line);
+
+    // Stream drivers behind the command line options, writing to out.
+    // runBenchmarks() loads every synthetic network into this engine.
+    void runBatch(std::istream &in, FILE *out, int threads);
+    void runTicketIssuing(std::istream &in, FILE *out, int threads, TicketFormat format);
+    void runIsochrones(std::istream &in, FILE *out, int radius, int threads);
+    bool runAssignment(std::istream &in, FILE *out, int threads, double capacity, int iterations);
+    void runBenchmarks(const std::vector<SyntheticNetworkSpec> &specs, FILE *out);
+
+    // Serves queries on a Unix socket path or a local TCP port until
+    // accepting fails; returns the exit status
+    int serve(const std::string &address, int threads);
+
+    // Distance and fare of every station pair, written once and mapped
+    // by loadOdMatrix() for OD queries
+    bool writeOdMatrix(const std::string &fileName, int threads);
+    bool loadOdMatrix(const std::string &fileName);
+
+    // Latency and work metrics of this engine: JSON for *.json, else Prometheus text
+    bool writeMetricsFile(const std::string &fileName);
+
+private:
+    std::unique_ptr<EngineState> state;
+};
+
+// Parses "LINESxSTATIONS[xINTERCHANGES[xBRANCHES]],..." for runBenchmarks()
+bool parseBenchmarkSizes(const std::string &text, std::vector<SyntheticNetworkSpec> &specs);
+
+// Local time as minutes after midnight, for fare periods
+int currentMinuteOfDay();
+
+#endif